@@ -0,0 +1,1133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h> // For measuring build and search time
+#include "Stats.h"  // Optional --stats instrumentation
+#include "PostingList.h" // Line posting lists for multi-term queries
+
+#define ALPHABET_SIZE 256
+#define WORDS_PER_BLOCK 8           // 64-bit words covered by one 16-bit block counter (512 bits)
+#define WORDS_PER_SUPERBLOCK 1024   // 64-bit words covered by one 64-bit superblock counter
+#define DEFAULT_SAMPLE_RATE 32      // Keep the suffix array entry of every 32nd text position
+#define MAX_QUERY_ATOMS 16          // Terms (or NEAR pairs) AND-ed in one clause
+#define MAX_QUERY_CLAUSES 16        // Clauses OR-ed in one query
+#define MAX_NEAR_DISTANCE 100       // Largest k in NEAR/k; each anchor extracts about 2k words
+
+// Bit vector with a two-level rank directory (about 3% on top of the bits)
+typedef struct {
+    uint64_t* bits;          // Packed bits, 64 per word
+    uint64_t* superRank;     // Number of set bits before each superblock
+    uint16_t* blockRank;     // Number of set bits before each block, within its superblock
+    long long length;        // Number of bits
+} RankBitVector;
+
+// Node of the Huffman-shaped wavelet tree
+typedef struct {
+    RankBitVector bits;  // 0 = symbol continues into child[0], 1 = into child[1]
+    int child[2];        // Index of the child node, or -1 - symbol for a leaf
+} WaveletNode;
+
+// Huffman-shaped wavelet tree: frequent symbols get short paths, so the
+// bit vectors total about nH0 bits instead of 8n
+typedef struct {
+    WaveletNode* nodes;
+    int nodeCount;
+    int root;
+    uint64_t code[ALPHABET_SIZE];    // Branch taken at depth d is bit d of the code
+    int codeLength[ALPHABET_SIZE];   // 0 for symbols that do not occur
+} WaveletTree;
+
+// Compressed self-index: the text itself is not kept after the build
+typedef struct {
+    WaveletTree bwt;                // Burrows-Wheeler transform with rank/access support
+    long long C[ALPHABET_SIZE];     // C[c] = number of symbols in the text smaller than c
+    RankBitVector sampledRows;      // Marks BWT rows whose suffix array entry is kept
+    uint64_t* saSamples;            // Kept suffix array entries in row order, bit-packed
+    uint64_t* isaSamples;           // Row of every sampled text position, for extracting text
+    int sampleBits;                 // Width of one packed entry
+    long long sampleCount;          // Number of kept entries
+    long long sampleRate;           // Distance between sampled text positions
+    long long length;               // Text length including the sentinel
+} FMIndex;
+
+// Dynamic array to store positions of line breaks in the text
+long long *v1 = NULL;
+int v1_size = 0;      // Number of lines in the file
+long long fm_backward_steps = 0; // Backward search steps taken by countPattern
+long long fm_lf_steps = 0;       // LF steps taken by locateRow and extractText
+long long fm_terms_located = 0;  // Query terms whose occurrences were all located
+long long fm_lines_verified = 0; // Candidate lines extracted and checked by a query
+
+// Function to allocate a zeroed bit vector of the given length
+int initBitVector(RankBitVector* bv, long long length) {
+    long long words = (length + 63) / 64;
+    bv->bits = (uint64_t*)calloc(words + 1, sizeof(uint64_t));
+    bv->superRank = NULL;
+    bv->blockRank = NULL;
+    bv->length = length;
+    return bv->bits != NULL;
+}
+
+void setBit(RankBitVector* bv, long long i) {
+    bv->bits[i >> 6] |= 1ULL << (i & 63);
+}
+
+int getBit(const RankBitVector* bv, long long i) {
+    return (int)((bv->bits[i >> 6] >> (i & 63)) & 1);
+}
+
+// Function to build the rank directory once all bits have been set
+int buildRankDirectory(RankBitVector* bv) {
+    long long words = (bv->length + 63) / 64;
+    bv->superRank = (uint64_t*)malloc((words / WORDS_PER_SUPERBLOCK + 1) * sizeof(uint64_t));
+    bv->blockRank = (uint16_t*)malloc((words / WORDS_PER_BLOCK + 1) * sizeof(uint16_t));
+    if (!bv->superRank || !bv->blockRank) {
+        return 0;
+    }
+
+    // One extra step past the last word so that rank1(length) has its counters
+    uint64_t total = 0;
+    for (long long w = 0; w <= words; w++) {
+        if (w % WORDS_PER_SUPERBLOCK == 0) {
+            bv->superRank[w / WORDS_PER_SUPERBLOCK] = total;
+        }
+        if (w % WORDS_PER_BLOCK == 0) {
+            bv->blockRank[w / WORDS_PER_BLOCK] = (uint16_t)(total - bv->superRank[w / WORDS_PER_SUPERBLOCK]);
+        }
+        if (w < words) {
+            total += __builtin_popcountll(bv->bits[w]);
+        }
+    }
+    return 1;
+}
+
+// Function to count the set bits in positions [0, i)
+long long rank1(const RankBitVector* bv, long long i) {
+    long long w = i >> 6;
+    long long block = w / WORDS_PER_BLOCK;
+    long long r = (long long)bv->superRank[w / WORDS_PER_SUPERBLOCK] + bv->blockRank[block];
+    for (long long k = block * WORDS_PER_BLOCK; k < w; k++) {
+        r += __builtin_popcountll(bv->bits[k]);
+    }
+    if (i & 63) {
+        r += __builtin_popcountll(bv->bits[w] & ((1ULL << (i & 63)) - 1));
+    }
+    return r;
+}
+
+long long rank0(const RankBitVector* bv, long long i) {
+    return i - rank1(bv, i);
+}
+
+size_t bitVectorBytes(const RankBitVector* bv) {
+    long long words = (bv->length + 63) / 64;
+    return (words + 1) * sizeof(uint64_t)
+         + (words / WORDS_PER_SUPERBLOCK + 1) * sizeof(uint64_t)
+         + (words / WORDS_PER_BLOCK + 1) * sizeof(uint16_t);
+}
+
+void freeBitVector(RankBitVector* bv) {
+    free(bv->bits);
+    free(bv->superRank);
+    free(bv->blockRank);
+}
+
+// Function to assign codes by walking the tree from the given node
+void assignCodes(WaveletTree* wt, int node, uint64_t code, int depth) {
+    for (int b = 0; b < 2; b++) {
+        int child = wt->nodes[node].child[b];
+        uint64_t childCode = code | ((uint64_t)b << depth);
+        if (child < 0) {
+            wt->code[-1 - child] = childCode;
+            wt->codeLength[-1 - child] = depth + 1;
+        } else {
+            assignCodes(wt, child, childCode, depth + 1);
+        }
+    }
+}
+
+// Function to fill the bit vectors of a subtree; symbols[] is partitioned in place
+int fillWaveletNode(WaveletTree* wt, int node, unsigned char* symbols, unsigned char* scratch,
+                    long long n, int depth) {
+    RankBitVector* bv = &wt->nodes[node].bits;
+    if (!initBitVector(bv, n)) {
+        return 0;
+    }
+
+    long long zeros = 0;
+    for (long long i = 0; i < n; i++) {
+        if ((wt->code[symbols[i]] >> depth) & 1) {
+            setBit(bv, i);
+        } else {
+            zeros++;
+        }
+    }
+    if (!buildRankDirectory(bv)) {
+        return 0;
+    }
+
+    // Stable partition: the left child's symbols first, then the right child's
+    long long z = 0, o = zeros;
+    for (long long i = 0; i < n; i++) {
+        if ((wt->code[symbols[i]] >> depth) & 1) {
+            scratch[o++] = symbols[i];
+        } else {
+            scratch[z++] = symbols[i];
+        }
+    }
+    memcpy(symbols, scratch, n);
+
+    int left = wt->nodes[node].child[0], right = wt->nodes[node].child[1];
+    if (left >= 0 && !fillWaveletNode(wt, left, symbols, scratch, zeros, depth + 1)) {
+        return 0;
+    }
+    if (right >= 0 && !fillWaveletNode(wt, right, symbols + zeros, scratch, n - zeros, depth + 1)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Function to build a Huffman-shaped wavelet tree; needs at least two distinct symbols
+int buildWaveletTree(WaveletTree* wt, const unsigned char* symbols, long long n,
+                     const long long freq[ALPHABET_SIZE]) {
+    long long weight[ALPHABET_SIZE];
+    int item[ALPHABET_SIZE];  // Leaf (-1 - symbol) or internal node index
+    int items = 0;
+    for (int c = 0; c < ALPHABET_SIZE; c++) {
+        wt->codeLength[c] = 0;
+        wt->code[c] = 0;
+        if (freq[c] > 0) {
+            weight[items] = freq[c];
+            item[items] = -1 - c;
+            items++;
+        }
+    }
+
+    wt->nodes = (WaveletNode*)calloc(items, sizeof(WaveletNode));
+    wt->nodeCount = 0;
+    if (!wt->nodes) {
+        return 0;
+    }
+
+    // Huffman merging: the alphabet is tiny, so a linear scan for the two lightest is enough
+    while (items > 1) {
+        int a = 0, b = 1;
+        if (weight[b] < weight[a]) { a = 1; b = 0; }
+        for (int k = 2; k < items; k++) {
+            if (weight[k] < weight[a]) { b = a; a = k; }
+            else if (weight[k] < weight[b]) { b = k; }
+        }
+        int node = wt->nodeCount++;
+        wt->nodes[node].child[0] = item[a];
+        wt->nodes[node].child[1] = item[b];
+        weight[a] += weight[b];
+        item[a] = node;
+        weight[b] = weight[items - 1];
+        item[b] = item[items - 1];
+        items--;
+    }
+    wt->root = wt->nodeCount - 1;
+    assignCodes(wt, wt->root, 0, 0);
+
+    unsigned char* work = (unsigned char*)malloc(n);
+    unsigned char* scratch = (unsigned char*)malloc(n);
+    int ok = work && scratch;
+    if (ok) {
+        memcpy(work, symbols, n);
+        ok = fillWaveletNode(wt, wt->root, work, scratch, n, 0);
+    }
+    free(work);
+    free(scratch);
+    return ok;
+}
+
+// Function to count occurrences of symbol c in positions [0, i)
+long long waveletRank(const WaveletTree* wt, unsigned char c, long long i) {
+    int node = wt->root;
+    for (int depth = 0; depth < wt->codeLength[c]; depth++) {
+        int b = (int)((wt->code[c] >> depth) & 1);
+        i = b ? rank1(&wt->nodes[node].bits, i) : rank0(&wt->nodes[node].bits, i);
+        node = wt->nodes[node].child[b];
+    }
+    return wt->codeLength[c] ? i : 0;
+}
+
+// Function to recover the symbol at position i together with its rank up to i
+unsigned char waveletAccessRank(const WaveletTree* wt, long long i, long long* rank) {
+    int node = wt->root;
+    while (node >= 0) {
+        const RankBitVector* bv = &wt->nodes[node].bits;
+        int b = getBit(bv, i);
+        i = b ? rank1(bv, i) : rank0(bv, i);
+        node = wt->nodes[node].child[b];
+    }
+    *rank = i;
+    return (unsigned char)(-1 - node);
+}
+
+size_t waveletTreeBytes(const WaveletTree* wt) {
+    size_t bytes = wt->nodeCount * sizeof(WaveletNode);
+    for (int k = 0; k < wt->nodeCount; k++) {
+        bytes += bitVectorBytes(&wt->nodes[k].bits);
+    }
+    return bytes;
+}
+
+void freeWaveletTree(WaveletTree* wt) {
+    for (int k = 0; k < wt->nodeCount; k++) {
+        freeBitVector(&wt->nodes[k].bits);
+    }
+    free(wt->nodes);
+}
+
+// Functions to store and read fixed-width entries in a packed array
+void setPacked(uint64_t* packed, int width, long long index, uint64_t value) {
+    long long bit = index * width;
+    long long w = bit >> 6;
+    int offset = (int)(bit & 63);
+    packed[w] |= value << offset;
+    if (offset + width > 64) {
+        packed[w + 1] |= value >> (64 - offset);
+    }
+}
+
+uint64_t getPacked(const uint64_t* packed, int width, long long index) {
+    long long bit = index * width;
+    long long w = bit >> 6;
+    int offset = (int)(bit & 63);
+    uint64_t value = packed[w] >> offset;
+    if (offset + width > 64) {
+        value |= packed[w + 1] << (64 - offset);
+    }
+    return width == 64 ? value : value & ((1ULL << width) - 1);
+}
+
+// Function to build the suffix array by prefix doubling with radix sort, O(n log n)
+long long* buildSuffixArray(const unsigned char* text, long long n) {
+    if (n < 1) return NULL; // There is always at least the sentinel
+    long long* sa = (long long*)malloc(n * sizeof(long long));
+    long long* rank = (long long*)malloc(n * sizeof(long long));
+    long long* tmp = (long long*)malloc(n * sizeof(long long));
+    long long* cnt = (long long*)malloc((n > ALPHABET_SIZE ? n : ALPHABET_SIZE) * sizeof(long long));
+    if (!sa || !rank || !tmp || !cnt) {
+        free(sa);
+        free(rank);
+        free(tmp);
+        free(cnt);
+        return NULL;
+    }
+
+    // Sort suffixes by their first character
+    memset(cnt, 0, ALPHABET_SIZE * sizeof(long long));
+    for (long long i = 0; i < n; i++) cnt[text[i]]++;
+    for (int c = 1; c < ALPHABET_SIZE; c++) cnt[c] += cnt[c - 1];
+    for (long long i = n - 1; i >= 0; i--) sa[--cnt[text[i]]] = i;
+
+    rank[sa[0]] = 0;
+    for (long long i = 1; i < n; i++) {
+        rank[sa[i]] = rank[sa[i - 1]] + (text[sa[i]] != text[sa[i - 1]]);
+    }
+    long long classes = rank[sa[n - 1]] + 1;
+
+    for (long long k = 1; classes < n; k <<= 1) {
+        // Order by the second key: suffixes shorter than k come first
+        long long p = 0;
+        for (long long i = n - k; i < n; i++) {
+            if (i >= 0) tmp[p++] = i;
+        }
+        for (long long j = 0; j < n; j++) {
+            if (sa[j] >= k) tmp[p++] = sa[j] - k;
+        }
+
+        // Stable counting sort by the first key
+        memset(cnt, 0, classes * sizeof(long long));
+        for (long long i = 0; i < n; i++) cnt[rank[i]]++;
+        for (long long c = 1; c < classes; c++) cnt[c] += cnt[c - 1];
+        for (long long j = n - 1; j >= 0; j--) sa[--cnt[rank[tmp[j]]]] = tmp[j];
+
+        // Re-rank by (rank[i], rank[i + k]) pairs
+        tmp[sa[0]] = 0;
+        for (long long i = 1; i < n; i++) {
+            long long prev = sa[i - 1], cur = sa[i];
+            long long prevSecond = prev + k < n ? rank[prev + k] : -1;
+            long long curSecond = cur + k < n ? rank[cur + k] : -1;
+            int same = rank[prev] == rank[cur] && prevSecond == curSecond;
+            tmp[cur] = tmp[prev] + !same;
+        }
+        long long* swap = rank;
+        rank = tmp;
+        tmp = swap;
+        classes = rank[sa[n - 1]] + 1;
+    }
+
+    free(rank);
+    free(tmp);
+    free(cnt);
+    return sa;
+}
+
+// Function to build the FM-index of a NUL-terminated text; the NUL acts as the sentinel.
+// withExtract also keeps inverse suffix array samples, which extractText needs.
+int buildFMIndex(FMIndex* fm, const char* text, long long textLen, long long sampleRate, int withExtract) {
+    const unsigned char* t = (const unsigned char*)text;
+    long long n = textLen + 1;
+    memset(fm, 0, sizeof(FMIndex));
+    fm->length = n;
+    fm->sampleRate = sampleRate;
+
+    long long* sa = buildSuffixArray(t, n);
+    if (!sa) {
+        return 0;
+    }
+
+    // BWT: the character preceding each sorted suffix
+    unsigned char* bwt = (unsigned char*)malloc(n);
+    if (!bwt) {
+        free(sa);
+        return 0;
+    }
+    for (long long i = 0; i < n; i++) {
+        bwt[i] = sa[i] > 0 ? t[sa[i] - 1] : t[n - 1];
+    }
+
+    // C array from the symbol frequencies
+    long long freq[ALPHABET_SIZE] = {0};
+    for (long long i = 0; i < n; i++) freq[t[i]]++;
+    long long sum = 0;
+    for (int c = 0; c < ALPHABET_SIZE; c++) {
+        fm->C[c] = sum;
+        sum += freq[c];
+    }
+
+    // Keep the suffix array entries of text positions divisible by the sample rate.
+    // Position 0 is always kept, so locate never walks past the start of the text.
+    fm->sampleCount = (n + sampleRate - 1) / sampleRate;
+    fm->sampleBits = 64 - __builtin_clzll((unsigned long long)(n - 1));
+    fm->saSamples = (uint64_t*)calloc((fm->sampleCount * fm->sampleBits + 63) / 64 + 1, sizeof(uint64_t));
+    if (withExtract) {
+        fm->isaSamples = (uint64_t*)calloc((fm->sampleCount * fm->sampleBits + 63) / 64 + 1, sizeof(uint64_t));
+    }
+    if (!fm->saSamples || (withExtract && !fm->isaSamples) || !initBitVector(&fm->sampledRows, n)) {
+        free(sa);
+        free(bwt);
+        return 0;
+    }
+    long long k = 0;
+    for (long long i = 0; i < n; i++) {
+        if (sa[i] % sampleRate == 0) {
+            setBit(&fm->sampledRows, i);
+            setPacked(fm->saSamples, fm->sampleBits, k++, (uint64_t)sa[i]);
+            if (fm->isaSamples) setPacked(fm->isaSamples, fm->sampleBits, sa[i] / sampleRate, (uint64_t)i);
+        }
+    }
+    free(sa);
+
+    int ok = buildRankDirectory(&fm->sampledRows) && buildWaveletTree(&fm->bwt, bwt, n, freq);
+    free(bwt);
+    return ok;
+}
+
+// Function to count pattern occurrences by backward search; stores the first BWT row
+long long countPattern(const FMIndex* fm, const char* pat, long long* firstRow) {
+    long long M = (long long)strlen(pat);
+    long long sp = 0, ep = fm->length;
+    if (M == 0) {
+        return 0;
+    }
+
+    for (long long i = M - 1; i >= 0; i--) {
+        unsigned char c = (unsigned char)pat[i];
+        sp = fm->C[c] + waveletRank(&fm->bwt, c, sp);
+        ep = fm->C[c] + waveletRank(&fm->bwt, c, ep);
+        fm_backward_steps++;
+        if (sp >= ep) {
+            return 0;
+        }
+    }
+    *firstRow = sp;
+    return ep - sp;
+}
+
+// Function to map a BWT row to its text position by walking LF to the nearest sample
+long long locateRow(const FMIndex* fm, long long row) {
+    long long steps = 0;
+    while (!getBit(&fm->sampledRows, row)) {
+        long long rank;
+        unsigned char c = waveletAccessRank(&fm->bwt, row, &rank);
+        row = fm->C[c] + rank;
+        steps++;
+    }
+    fm_lf_steps += steps;
+    return (long long)getPacked(fm->saSamples, fm->sampleBits, rank1(&fm->sampledRows, row)) + steps;
+}
+
+// Function to recover text[from, to) by walking LF backwards from the next sampled position
+void extractText(const FMIndex* fm, long long from, long long to, char* out) {
+    long long pos = (to + fm->sampleRate - 1) / fm->sampleRate * fm->sampleRate;
+    long long row;
+    if (pos >= fm->length - 1) {
+        pos = fm->length - 1; // The sentinel suffix is always row 0
+        row = 0;
+    } else {
+        row = (long long)getPacked(fm->isaSamples, fm->sampleBits, pos / fm->sampleRate);
+    }
+
+    out[to - from] = '\0';
+    while (pos > from) {
+        long long rank;
+        unsigned char c = waveletAccessRank(&fm->bwt, row, &rank);
+        row = fm->C[c] + rank;
+        pos--;
+        if (pos < to) {
+            out[pos - from] = (char)c;
+        }
+        fm_lf_steps++;
+    }
+}
+
+// Function to report the memory held by the index
+size_t fmIndexBytes(const FMIndex* fm) {
+    size_t bytes = sizeof(FMIndex) + waveletTreeBytes(&fm->bwt);
+    bytes += bitVectorBytes(&fm->sampledRows);
+    size_t sampleBytes = ((fm->sampleCount * fm->sampleBits + 63) / 64 + 1) * sizeof(uint64_t);
+    bytes += fm->isaSamples ? 2 * sampleBytes : sampleBytes;
+    return bytes;
+}
+
+void freeFMIndex(FMIndex* fm) {
+    freeWaveletTree(&fm->bwt);
+    freeBitVector(&fm->sampledRows);
+    free(fm->saSamples);
+    free(fm->isaSamples);
+}
+
+int comparePositions(const void* a, const void* b) {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to find the number of line breaks at or before a text position
+long long lineOfPosition(long long pos) {
+    long long lo = 0, hi = v1_size;
+    while (lo < hi) {
+        long long mid = (lo + hi) / 2;
+        if (v1[mid] <= pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// One query atom: a literal term, or two terms that must occur within `distance` words of each other
+typedef struct {
+    const char* term;
+    const char* nearTerm;   // NULL for a plain term
+    int distance;
+    const char* anchor;     // The rarer of the two terms; it is the one that gets located
+    long long estimate;     // Occurrences of the anchor, from a backward search
+} QueryAtom;
+
+// Atoms AND-ed together
+typedef struct {
+    QueryAtom atoms[MAX_QUERY_ATOMS];
+    int atomCount;
+} QueryClause;
+
+// Clauses OR-ed together
+typedef struct {
+    QueryClause clauses[MAX_QUERY_CLAUSES];
+    int clauseCount;
+} Query;
+
+// Function to parse "a AND b OR c NEAR/3 d" into OR-ed clauses of AND-ed atoms; adjacent terms are AND-ed.
+// Terms point into text, which is modified. Returns 0 on a syntax error.
+int parseQuery(char* text, Query* query) {
+    memset(query, 0, sizeof(Query));
+    QueryClause* clause = &query->clauses[0];
+    query->clauseCount = 1;
+    int expectTerm = 1, pendingNear = 0;
+
+    for (char* tok = strtok(text, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        if (strcmp(tok, "AND") == 0) {
+            if (expectTerm) return 0;
+            expectTerm = 1;
+        } else if (strcmp(tok, "OR") == 0) {
+            if (expectTerm || query->clauseCount == MAX_QUERY_CLAUSES) return 0;
+            clause = &query->clauses[query->clauseCount++];
+            expectTerm = 1;
+        } else if (strncmp(tok, "NEAR/", 5) == 0) {
+            if (expectTerm) return 0;
+            QueryAtom* atom = &clause->atoms[clause->atomCount - 1];
+            char* end;
+            long distance = strtol(tok + 5, &end, 10);
+            if (atom->nearTerm || end == tok + 5 || *end != '\0' || distance < 0 || distance > MAX_NEAR_DISTANCE) return 0;
+            atom->distance = (int)distance;
+            pendingNear = 1;
+            expectTerm = 1;
+        } else {
+            if (pendingNear) {
+                clause->atoms[clause->atomCount - 1].nearTerm = tok;
+                pendingNear = 0;
+            } else {
+                if (clause->atomCount == MAX_QUERY_ATOMS) return 0;
+                clause->atoms[clause->atomCount++].term = tok;
+            }
+            expectTerm = 0;
+        }
+    }
+    return !expectTerm;
+}
+
+int isWordSeparator(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+// Function to find the number of the word containing text[offset]
+int wordIndexAt(const char* text, long long offset) {
+    int words = 0;
+    for (long long j = 0; j <= offset; j++) {
+        if (!isWordSeparator(text[j]) && (j == 0 || isWordSeparator(text[j - 1]))) {
+            words++;
+        }
+    }
+    return words - 1;
+}
+
+// Function to extract one line (including its newline) from the index; the caller frees it
+char* extractLine(const FMIndex* fm, int line) {
+    long long from = line == 0 ? 0 : v1[line - 1] + 1;
+    long long to = v1[line];
+    char* text = (char*)malloc(to - from + 1);
+    if (text) {
+        extractText(fm, from, to, text);
+    }
+    return text;
+}
+
+// Function to locate every occurrence of a term; returns the positions in text order
+long long* locateAll(const FMIndex* fm, const char* term, long long* count) {
+    long long firstRow = 0;
+    *count = countPattern(fm, term, &firstRow);
+    long long* positions = (long long*)malloc((*count ? *count : 1) * sizeof(long long));
+    if (!positions) return NULL;
+
+    for (long long r = 0; r < *count; r++) {
+        positions[r] = locateRow(fm, firstRow + r);
+    }
+    qsort(positions, *count, sizeof(long long), comparePositions);
+    fm_terms_located++;
+    return positions;
+}
+
+// Function to build the line posting list of a term by locating all its occurrences
+int termLines(const FMIndex* fm, const char* term, PostingList* out) {
+    postingInit(out);
+    long long count;
+    long long* positions = locateAll(fm, term, &count);
+    if (!positions) return 0;
+
+    int ok = 1;
+    for (long long r = 0; r < count && ok; r++) {
+        ok = postingAppend(out, (int)lineOfPosition(positions[r]));
+    }
+    free(positions);
+    return ok;
+}
+
+// Function to keep the candidate lines that contain the term
+int filterLines(const FMIndex* fm, const PostingList* candidates, const char* term, PostingList* out) {
+    postingInit(out);
+    PostingIterator it;
+    postingIterStart(&it, candidates);
+    int line;
+    while ((line = postingIterNext(&it)) >= 0) {
+        char* text = extractLine(fm, line);
+        if (!text) return 0;
+        int keep = strstr(text, term) != NULL;
+        free(text);
+        fm_lines_verified++;
+        if (keep && !postingAppend(out, line)) return 0;
+    }
+    return 1;
+}
+
+int compareLines(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Function to count the words in a piece of text
+int countWords(const char* text) {
+    int words = 0;
+    for (long long j = 0; text[j] != '\0'; j++) {
+        if (!isWordSeparator(text[j]) && (j == 0 || isWordSeparator(text[j - 1]))) {
+            words++;
+        }
+    }
+    return words;
+}
+
+// Function to add an extracted line to a growable list of lines
+int pushLine(char*** lines, int* count, int* capacity, char* line) {
+    if (*count == *capacity) {
+        int grownCapacity = *capacity ? *capacity * 2 : 8;
+        char** grown = (char**)realloc(*lines, grownCapacity * sizeof(char*));
+        if (!grown) return 0;
+        *lines = grown;
+        *capacity = grownCapacity;
+    }
+    (*lines)[(*count)++] = line;
+    return 1;
+}
+
+// Function to extract the run of whole lines around text position pos that holds `distance`
+// words on both sides of the word at pos. Every line is extracted and counted once, then the
+// lines are joined. Returns text[*from, end) and sets *anchorWord to the number of the word
+// at pos in it, or returns NULL on allocation failure.
+char* extractNearWindow(const FMIndex* fm, long long pos, int distance, long long* from, int* anchorWord) {
+    int line = (int)lineOfPosition(pos);
+    char** before = NULL;   // Lines line - 1, line - 2, ... in that order
+    char** after = NULL;    // Lines line, line + 1, ...
+    int beforeCount = 0, beforeCapacity = 0, afterCount = 0, afterCapacity = 0;
+    char* window = NULL;
+    int ok = 1;
+
+    char* text = extractLine(fm, line);
+    if (!text || !pushLine(&after, &afterCount, &afterCapacity, text)) {
+        free(text);
+        ok = 0;
+    }
+    int wordsBefore = 0, wordsAfter = 0;
+    if (ok) {
+        wordsBefore = wordIndexAt(text, pos - (line == 0 ? 0 : v1[line - 1] + 1));
+        wordsAfter = countWords(text) - 1 - wordsBefore;
+        fm_lines_verified++;
+    }
+    while (ok && wordsBefore < distance && line - beforeCount > 0) {
+        text = extractLine(fm, line - beforeCount - 1);
+        if (!text || !pushLine(&before, &beforeCount, &beforeCapacity, text)) {
+            free(text);
+            ok = 0;
+            break;
+        }
+        wordsBefore += countWords(text);
+        fm_lines_verified++;
+    }
+    while (ok && wordsAfter < distance && line + afterCount < v1_size) {
+        text = extractLine(fm, line + afterCount);
+        if (!text || !pushLine(&after, &afterCount, &afterCapacity, text)) {
+            free(text);
+            ok = 0;
+            break;
+        }
+        wordsAfter += countWords(text);
+        fm_lines_verified++;
+    }
+
+    if (ok) {
+        // Join the lines with the separator that sits between them in the text
+        int first = line - beforeCount, last = line + afterCount - 1;
+        *from = first == 0 ? 0 : v1[first - 1] + 1;
+        long long length = v1[last] - *from;
+        window = (char*)malloc(length + 1);
+        if (window) {
+            long long at = 0;
+            for (int k = beforeCount - 1; k >= 0; k--) {
+                size_t n = strlen(before[k]);
+                memcpy(window + at, before[k], n);
+                at += n;
+                window[at++] = ' ';
+            }
+            for (int k = 0; k < afterCount; k++) {
+                size_t n = strlen(after[k]);
+                memcpy(window + at, after[k], n);
+                at += n;
+                if (k + 1 < afterCount) window[at++] = ' ';
+            }
+            window[at] = '\0';
+            *anchorWord = wordsBefore;
+        }
+    }
+    for (int k = 0; k < beforeCount; k++) free(before[k]);
+    for (int k = 0; k < afterCount; k++) free(after[k]);
+    free(before);
+    free(after);
+    return window;
+}
+
+// Function to find the lines on which a NEAR pair starts. Distances are measured on text
+// positions: every located occurrence of the anchor is checked against the other term in a
+// window of whole lines around it that holds `distance` words on either side, so pairs split
+// by a line break are found too. The two terms must be distinct occurrences: an occurrence of
+// the other term that overlaps the anchor occurrence (e.g. "Holmes NEAR/5 Holmes") does not count.
+int nearLines(const FMIndex* fm, const QueryAtom* atom, PostingList* out) {
+    postingInit(out);
+    const char* other = atom->anchor == atom->term ? atom->nearTerm : atom->term;
+    long long anchorLength = (long long)strlen(atom->anchor);
+    long long otherLength = (long long)strlen(other);
+    long long count;
+    long long* positions = locateAll(fm, atom->anchor, &count);
+    int startCapacity = count ? (int)count : 1;
+    int* starts = (int*)malloc(startCapacity * sizeof(int));
+    if (!positions || !starts) {
+        free(positions);
+        free(starts);
+        return 0;
+    }
+
+    int startCount = 0;
+    int ok = 1;
+    for (long long r = 0; r < count && ok; r++) {
+        long long from;
+        int anchorWord;
+        char* window = extractNearWindow(fm, positions[r], atom->distance, &from, &anchorWord);
+        if (!window) {
+            ok = 0;
+            break;
+        }
+        long long anchorOffset = positions[r] - from;
+
+        // One pass over the window: the word counter only moves forward between occurrences.
+        // Every pair counts, since one anchor can pair with terms that start on different lines.
+        long long scanned = 0;
+        int words = 0;
+        for (const char* b = strstr(window, other); b && ok; b = strstr(b + 1, other)) {
+            long long offset = b - window;
+            for (; scanned <= offset; scanned++) {
+                if (!isWordSeparator(window[scanned]) && (scanned == 0 || isWordSeparator(window[scanned - 1]))) {
+                    words++;
+                }
+            }
+            if (offset < anchorOffset + anchorLength && anchorOffset < offset + otherLength) continue;
+            int gap = words - 1 - anchorWord;
+            if (gap > atom->distance) break;
+            if (-gap > atom->distance) continue;
+            if (startCount == startCapacity) {
+                int* grown = (int*)realloc(starts, startCapacity * 2 * sizeof(int));
+                if (!grown) {
+                    ok = 0;
+                    break;
+                }
+                starts = grown;
+                startCapacity *= 2;
+            }
+            long long pairStart = offset + from < positions[r] ? offset + from : positions[r];
+            starts[startCount++] = (int)lineOfPosition(pairStart);
+        }
+        free(window);
+    }
+
+    // Pairs are found in anchor order; the line a pair starts on can come before an earlier one's
+    qsort(starts, startCount, sizeof(int), compareLines);
+    for (int k = 0; k < startCount && ok; k++) {
+        ok = postingAppend(out, starts[k]);
+    }
+    free(positions);
+    free(starts);
+    return ok;
+}
+
+// Function to build the line posting list of an atom on its own
+int atomLines(const FMIndex* fm, const QueryAtom* atom, PostingList* out) {
+    if (!atom->nearTerm) {
+        return termLines(fm, atom->term, out);
+    }
+    return nearLines(fm, atom, out);
+}
+
+// Function to evaluate AND-ed atoms, rarest first. Only the rarest atom is always located.
+// Each further term is either located and intersected, or checked on the surviving lines,
+// whichever the occurrence counts say is cheaper, so a frequent term costs little more
+// than the lines it has to be checked on. NEAR pairs can cross lines, so they are always
+// evaluated on positions and intersected.
+int evaluateClause(const FMIndex* fm, QueryClause* clause, double avgLineLength, PostingList* out) {
+    postingInit(out);
+    for (int k = 0; k < clause->atomCount; k++) {
+        QueryAtom* atom = &clause->atoms[k];
+        long long firstRow;
+        atom->anchor = atom->term;
+        atom->estimate = countPattern(fm, atom->term, &firstRow);
+        if (atom->nearTerm) {
+            long long other = countPattern(fm, atom->nearTerm, &firstRow);
+            if (other < atom->estimate) {
+                atom->anchor = atom->nearTerm;
+                atom->estimate = other;
+            }
+        }
+        if (atom->estimate == 0) {
+            return 1;
+        }
+    }
+
+    // Insertion sort by estimate: clauses are a handful of atoms
+    for (int k = 1; k < clause->atomCount; k++) {
+        QueryAtom atom = clause->atoms[k];
+        int j = k - 1;
+        while (j >= 0 && clause->atoms[j].estimate > atom.estimate) {
+            clause->atoms[j + 1] = clause->atoms[j];
+            j--;
+        }
+        clause->atoms[j + 1] = atom;
+    }
+
+    PostingList candidates;
+    if (!atomLines(fm, &clause->atoms[0], &candidates)) {
+        postingFree(&candidates);
+        return 0;
+    }
+
+    for (int k = 1; k < clause->atomCount && candidates.count > 0; k++) {
+        const QueryAtom* atom = &clause->atoms[k];
+        double locateCost = atom->estimate * (fm->sampleRate / 2.0 + 1);
+        double verifyCost = candidates.count * (avgLineLength + fm->sampleRate);
+
+        PostingList next;
+        int ok;
+        if (atom->nearTerm || locateCost < verifyCost) {
+            PostingList lines;
+            ok = atomLines(fm, atom, &lines) && postingIntersect(&candidates, &lines, &next);
+            postingFree(&lines);
+        } else {
+            ok = filterLines(fm, &candidates, atom->term, &next);
+        }
+        postingFree(&candidates);
+        candidates = next;
+        if (!ok) {
+            postingFree(&candidates);
+            return 0;
+        }
+    }
+
+    *out = candidates;
+    return 1;
+}
+
+// Function to evaluate a whole query into its matching lines
+int evaluateQuery(const FMIndex* fm, Query* query, double avgLineLength, PostingList* out) {
+    if (!evaluateClause(fm, &query->clauses[0], avgLineLength, out)) {
+        return 0;
+    }
+    for (int c = 1; c < query->clauseCount; c++) {
+        PostingList clauseLines, merged;
+        if (!evaluateClause(fm, &query->clauses[c], avgLineLength, &clauseLines)) {
+            return 0;
+        }
+        int ok = postingUnion(out, &clauseLines, &merged);
+        postingFree(&clauseLines);
+        postingFree(out);
+        *out = merged;
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+// Function to answer boolean and proximity queries until EOF or an empty line
+void runQueries(const FMIndex* fm, double avgLineLength) {
+    char text[1024];
+    while (1) {
+        printf("Enter query (terms with AND, OR, NEAR/k; empty line to stop): ");
+        if (!fgets(text, sizeof(text), stdin))
+            break;
+        text[strcspn(text, "\n")] = '\0';
+        if (text[0] == '\0')
+            break;
+
+        Query query;
+        if (!parseQuery(text, &query)) {
+            printf("Could not parse the query (NEAR/k takes 0 <= k <= %d). Example: Holmes AND Watson OR Baskerville NEAR/5 hound\n",
+                   MAX_NEAR_DISTANCE);
+            continue;
+        }
+
+        clock_t start = clock();
+        PostingList lines;
+        int ok = evaluateQuery(fm, &query, avgLineLength, &lines);
+        clock_t end = clock();
+        if (!ok) {
+            printf("Memory allocation failed.\n");
+            postingFree(&lines);
+            continue;
+        }
+
+        PostingIterator it;
+        postingIterStart(&it, &lines);
+        int line;
+        while ((line = postingIterNext(&it)) >= 0) {
+            char* lineText = extractLine(fm, line);
+            if (!lineText) break;
+            lineText[strcspn(lineText, "\n")] = '\0';
+            printf("Line %d: %s\n", line + 1, lineText);
+            free(lineText);
+        }
+        printf("Number of matching lines: %d\n", lines.count);
+        printf("Execution time: %.2f ms\n", ((double)(end - start) / CLOCKS_PER_SEC) * 1000);
+        postingFree(&lines);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long long sampleRate = DEFAULT_SAMPLE_RATE;
+    int queryMode = 0;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--sample-rate") == 0 && a + 1 < argc) {
+            sampleRate = atoll(argv[++a]);
+        } else if (strcmp(argv[a], "--query") == 0) {
+            queryMode = 1;
+        } else if (!statsParseArg(argc, argv, &a)) {
+            printf("Usage: %s [--sample-rate N] [--query] [--stats] [--stats-json FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sampleRate < 1) {
+        printf("Sample rate must be at least 1.\n");
+        return 1;
+    }
+
+    statsBeginPhase("load");
+    FILE *newfile = fopen("sherlock.txt", "r");
+    if (!newfile) {
+        printf("Failed to open the file.\n");
+        return 1;
+    }
+
+    char *s1 = NULL;           // Complete text of the file, only kept until the index is built
+    size_t s1_len = 0;         // Length of the complete text
+    size_t buffer_size = 1024; // Buffer size for reading lines
+    char *buffer = (char *)malloc(buffer_size);
+
+    if (!buffer) {
+        printf("Memory allocation failed.\n");
+        fclose(newfile);
+        return 1;
+    }
+
+    // Read the file line by line, using the same layout as the KMP and automaton searches
+    while (fgets(buffer, buffer_size, newfile)) {
+        size_t line_len = strlen(buffer);
+
+        s1 = realloc(s1, s1_len + line_len + 2); // +2 for space and null terminator
+        if (!s1) {
+            printf("Memory allocation failed.\n");
+            free(buffer);
+            fclose(newfile);
+            return 1;
+        }
+
+        memcpy(s1 + s1_len, buffer, line_len);
+        s1_len += line_len;
+        s1[s1_len] = ' ';
+        s1_len++;
+        s1[s1_len] = '\0';
+
+        v1 = realloc(v1, (v1_size + 1) * sizeof(long long));
+        if (!v1) {
+            printf("Memory allocation failed.\n");
+            free(s1);
+            free(buffer);
+            fclose(newfile);
+            return 1;
+        }
+
+        if (v1_size == 0) {
+            v1[v1_size] = line_len;
+        } else {
+            v1[v1_size] = v1[v1_size - 1] + line_len + 1;
+        }
+        v1_size++;
+    }
+
+    fclose(newfile);
+    free(buffer);
+    statsEndPhase();
+    if (!s1) {
+        printf("The file is empty.\n");
+        return 1;
+    }
+
+    // Build the index and drop the text: queries only touch the compressed structure
+    FMIndex fm;
+    statsBeginPhase("build");
+    clock_t build_start = clock();
+    if (!buildFMIndex(&fm, s1, (long long)s1_len, sampleRate, queryMode)) {
+        printf("Memory allocation failed.\n");
+        freeFMIndex(&fm);
+        free(s1);
+        free(v1);
+        return 1;
+    }
+    clock_t build_end = clock();
+    statsEndPhase();
+    free(s1);
+
+    size_t index_bytes = fmIndexBytes(&fm);
+    printf("Index built in %.2f ms: %zu bytes for %zu bytes of text (%.1f%%), sample rate %lld\n",
+           ((double)(build_end - build_start) / CLOCKS_PER_SEC) * 1000, index_bytes, s1_len,
+           100.0 * index_bytes / s1_len, sampleRate);
+
+    long long count_fm = 0;
+    if (queryMode) {
+        // Boolean and proximity queries over line posting lists
+        statsBeginPhase("queries");
+        runQueries(&fm, (double)s1_len / v1_size);
+        statsEndPhase();
+    } else {
+        // Read the pattern to search for
+        char s2[256];
+        printf("Enter pattern to search: ");
+        if (!fgets(s2, sizeof(s2), stdin)) {
+            s2[0] = '\0';
+        }
+        s2[strcspn(s2, "\n")] = '\0'; // Remove newline character
+
+        // Count is a backward search; locate resolves each matching row through the samples
+        statsBeginPhase("search");
+        clock_t start = clock();
+        long long firstRow = 0;
+        count_fm = countPattern(&fm, s2, &firstRow);
+        long long *positions = (long long *)malloc((count_fm ? count_fm : 1) * sizeof(long long));
+        if (!positions) {
+            printf("Memory allocation failed.\n");
+            freeFMIndex(&fm);
+            free(v1);
+            return 1;
+        }
+        for (long long r = 0; r < count_fm; r++) {
+            positions[r] = locateRow(&fm, firstRow + r);
+        }
+        clock_t end = clock();
+        statsEndPhase();
+
+        // Print occurrences in text order, with the same line/position convention as KMP
+        qsort(positions, count_fm, sizeof(long long), comparePositions);
+        for (long long r = 0; r < count_fm; r++) {
+            long long it = lineOfPosition(positions[r]);
+            long long c = it == 0 ? positions[r] + 1 : positions[r] - v1[it - 1];
+            printf("Found at line: %lld position: %lld\n", it + 1, c);
+        }
+
+        printf("Number of Occurrences: %lld\n", count_fm);
+        double time_taken = ((double)(end - start) / CLOCKS_PER_SEC) * 1000; // Time in milliseconds
+        printf("Execution time: %.2f ms\n", time_taken);
+
+        free(positions);
+    }
+
+    statsCounter("text_bytes", (long long)s1_len);
+    statsCounter("index_bytes", (long long)index_bytes);
+    statsCounter("wavelet_tree_bytes", (long long)waveletTreeBytes(&fm.bwt));
+    statsCounter("wavelet_nodes", fm.bwt.nodeCount);
+    statsCounter("sample_bytes", (long long)(index_bytes - waveletTreeBytes(&fm.bwt)));
+    statsCounter("backward_steps", fm_backward_steps);
+    statsCounter("lf_steps", fm_lf_steps);
+    statsCounter("matches", count_fm);
+    statsCounter("terms_located", fm_terms_located);
+    statsCounter("lines_verified", fm_lines_verified);
+    statsReport("fm_index");
+
+    freeFMIndex(&fm);
+    free(v1);
+
+    return 0;
+}
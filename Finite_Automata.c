@@ -2,13 +2,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h> // Include time.h for clock()
+#include "Stats.h"  // Optional --stats instrumentation
+#include "QueryCache.h" // Result cache for repeated queries (--cache-bytes)
 
 #define NO_OF_CHARS 256
+#define MAX_PATTERN_LENGTH 255
+#define SESSION_SUGGESTIONS 5 // Matches shown after each keystroke
 
 // Global variables
 long long *v1 = NULL;  // Array to store line-ending positions in the text file
 int count_fa = 0;      // Count of total occurrences of the prefix
 int v1_size = 0;       // Number of lines in the file
+long long fa_transitions = 0;   // DFA transitions taken while scanning the text
+long long fa_table_bytes = 0;   // Size of the transition table for the last pattern
+unsigned long long text_generation = 0; // Bumped by loadText, keys the result cache
 
 // Function to get the next state for the finite automaton
 int getNextState(char *pat, int M, int state, int x) {
@@ -36,130 +43,441 @@ void computeTF(char *pat, int M, int TF[][NO_OF_CHARS]) {
             TF[state][x] = getNextState(pat, M, state, x);
 }
 
-// Function to search for occurrences of a pattern in the text
-void search(char *pat, char *txt) {
+// Function to print the word containing a match that ends at txt[i]; returns 0 on allocation failure
+int printMatch(char *txt, int N, int i, int M) {
+    // Identify the start of the word
+    int start = i - M + 1;
+    while (start > 0 && txt[start - 1] != ' ')
+        start--;
+
+    // Identify the end of the word
+    int end = i;
+    while (end < N && txt[end] != ' ')
+        end++;
+
+    // Extract the word that contains the matched pattern
+    int word_len = end - start;
+    char *word = (char *)malloc(word_len + 1);
+    if (!word) {
+        printf("Memory allocation failed.\n");
+        return 0;
+    }
+    strncpy(word, txt + start, word_len);
+    word[word_len] = '\0';
+
+    // Find the line number and position within that line
+    long long it = 0;
+    while (it < v1_size && v1[it] <= start)
+        it++;
+
+    int c;
+    if (it == 0) {
+        c = start;
+    } else {
+        c = start - v1[it - 1];
+    }
+    if (it == 0) {
+        c++;
+    }
+
+    printf("Found '%s' at line: %lld position: %d\n", word, it + 1, c);
+    free(word);
+    return 1;
+}
+
+// Function to collect the start offsets of all occurrences of a pattern in the text
+int *findAllMatches(char *pat, char *txt, int *matchCount) {
     int M = strlen(pat);  // Length of the pattern
     int N = strlen(txt);  // Length of the text
+    int capacity = 16;    // Grows by doubling as matches are found
+    int count = 0;
+    int *matches = (int *)malloc(capacity * sizeof(int));
+    if (!matches) {
+        printf("Memory allocation failed.\n");
+        return NULL;
+    }
 
     int TF[M + 1][NO_OF_CHARS];
     computeTF(pat, M, TF);  // Build the transition function
+    fa_table_bytes = (long long)sizeof(TF);
 
     int i, state = 0;
+    long long transitions = 0; // Kept local so the scan loop stays in registers
     for (i = 0; i < N; i++) {
+        transitions++;
         state = TF[state][(unsigned char)txt[i]];  // Update state based on current character
 
         // If we've reached the accepting state (match found)
         if (state == M) {
-            // Identify the start of the word
-            int start = i - M + 1;
-            while (start > 0 && txt[start - 1] != ' ')
-                start--;
-
-            // Identify the end of the word
-            int end = i;
-            while (end < N && txt[end] != ' ')
-                end++;
-
-            // Extract the word that contains the matched pattern
-            int word_len = end - start;
-            char *word = (char *)malloc(word_len + 1);
-            if (!word) {
-                printf("Memory allocation failed.\n");
-                return;
+            if (count == capacity) {
+                capacity *= 2;
+                int *grown = (int *)realloc(matches, capacity * sizeof(int));
+                if (!grown) {
+                    printf("Memory allocation failed.\n");
+                    free(matches);
+                    fa_transitions += transitions;
+                    return NULL;
+                }
+                matches = grown;
             }
-            strncpy(word, txt + start, word_len);
-            word[word_len] = '\0';
-
-            // Find the line number and position within that line
-            long long it = 0;
-            while (it < v1_size && v1[it] <= start)
-                it++;
-
-            int c;
-            if (it == 0) {
-                c = start;
-            } else {
-                c = start - v1[it - 1];
-            }
-            if (it == 0) {
-                c++;
-            }
-
-            count_fa++;
-            printf("Found '%s' at line: %lld position: %d\n", word, it + 1, c);
-            free(word);
+            matches[count++] = i - M + 1;
         }
     }
+    fa_transitions += transitions;
+    *matchCount = count;
+    return matches;
 }
 
-int main() {
-    FILE *newfile = fopen("sherlock.txt", "r");
-    if (newfile == NULL) {
+// Function to search for occurrences of a pattern in the text and print each of them
+void search(char *pat, char *txt) {
+    int M = strlen(pat);
+    int N = strlen(txt);
+    int count = 0;
+    int *matches = findAllMatches(pat, txt, &count);
+    if (!matches)
+        return;
+
+    for (int k = 0; k < count; k++) {
+        count_fa++;
+        if (!printMatch(txt, N, matches[k] + M - 1, M))
+            break;
+    }
+    free(matches);
+}
+
+// Function to (re)load the text into `*text`, rebuilding the line table `v1`.
+// Every successful load bumps text_generation so cached results for the old text are dropped.
+int loadText(const char *filename, char **text, size_t *length) {
+    FILE *newfile = fopen(filename, "r");
+    if (!newfile) {
         printf("Failed to open the file.\n");
-        return 1;
+        return 0;
     }
 
-    char *s1 = NULL; // Holds the complete file content
-    size_t s1_len = 0;
-    size_t buffer_size = 1024;
-    char *buffer = (char *)malloc(buffer_size);
+    char *s1 = NULL;           // Complete text of the file
+    size_t s1_len = 0;         // Length of the complete text
+    long long *lines = NULL;   // Cumulative line ends, becomes v1
+    int lineCount = 0;
+    size_t buffer_size = 1024; // Buffer size for reading lines
+    char *buffer = (char *)malloc(buffer_size); // Buffer to hold each line
 
     if (!buffer) {
         printf("Memory allocation failed.\n");
         fclose(newfile);
-        return 1;
+        return 0;
     }
 
-    // Read the file line by line
+    // Read the file line by line and accumulate the content in `s1`
     while (fgets(buffer, buffer_size, newfile)) {
         size_t line_len = strlen(buffer);
-        s1 = realloc(s1, s1_len + line_len + 2); // +2 for space and null terminator
-        if (!s1) {
+
+        // Resize `s1` to fit the new line, a space, and null terminator
+        char *grown = realloc(s1, s1_len + line_len + 2); // +2 for space and null terminator
+        long long *grownLines = grown ? realloc(lines, (lineCount + 1) * sizeof(long long)) : NULL;
+        if (grown) s1 = grown;
+        if (grownLines) lines = grownLines;
+        if (!grown || !grownLines) {
             printf("Memory allocation failed.\n");
+            free(s1);
+            free(lines);
             free(buffer);
             fclose(newfile);
-            return 1;
+            return 0;
         }
 
-        // Append the line to s1
+        // Append the line to `s1`
         memcpy(s1 + s1_len, buffer, line_len);
         s1_len += line_len;
         s1[s1_len] = ' ';
         s1_len++;
         s1[s1_len] = '\0';
 
-        // Store the cumulative length of each line to determine line breaks
-        v1 = realloc(v1, (v1_size + 1) * sizeof(long long));
-        if (!v1) {
-            printf("Memory allocation failed.\n");
-            free(s1);
-            free(buffer);
-            fclose(newfile);
-            return 1;
-        }
-        if (v1_size == 0) {
-            v1[v1_size] = line_len;
+        // Store cumulative length of each line for line break positions
+        if (lineCount == 0) {
+            lines[lineCount] = line_len;
         } else {
-            v1[v1_size] = v1[v1_size - 1] + line_len + 1;
+            lines[lineCount] = lines[lineCount - 1] + line_len + 1;
         }
-        v1_size++;
+        lineCount++;
     }
+
     fclose(newfile);
     free(buffer);
 
-    printf("Enter prefix to search: ");
+    free(*text);
+    free(v1);
+    *text = s1;
+    *length = s1_len;
+    v1 = lines;
+    v1_size = lineCount;
+    text_generation++;
+    return 1;
+}
+
+// Function to answer a query through the result cache, running the automaton only on a miss
+void cachedSearch(QueryCache *cache, char *pat, char *txt) {
+    int M = strlen(pat);
+    int N = strlen(txt);
+    queryCacheBindText(cache, txt, N, text_generation);
+
+    QueryCacheEntry *entry = queryCacheLookup(cache, pat);
+    if (!entry) {
+        int count = 0;
+        int *matches = findAllMatches(pat, txt, &count);
+        if (!matches)
+            return;
+        entry = queryCacheInsert(cache, pat, matches, count);
+        if (!entry) {
+            printf("Memory allocation failed.\n");
+            return;
+        }
+    }
+
+    for (int k = 0; k < entry->count; k++) {
+        count_fa++;
+        if (!printMatch(txt, N, entry->positions[k] + M - 1, M))
+            break;
+    }
+}
+
+// Function to answer prefixes until EOF, reusing earlier results through the cache; ":reload" re-reads the text
+void runCachedQueries(char **txt, size_t *length, size_t budget) {
+    QueryCache *cache = queryCacheCreate(budget);
+    if (!cache) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+
     char s2[256];
-    scanf("%s", s2);
+    while (1) {
+        printf("Enter prefix to search: ");
+        if (scanf("%255s", s2) != 1)
+            break;
+        if (strcmp(s2, ":reload") == 0) {
+            // The text may have changed on disk: re-read it, which invalidates the cache
+            if (loadText("sherlock.txt", txt, length))
+                printf("Reloaded sherlock.txt (%zu bytes), cached results dropped\n", *length);
+            continue;
+        }
+
+        long long hits = cache->hits, extensions = cache->extensionHits;
+        int before = count_fa;
+        clock_t start_time = clock();
+        cachedSearch(cache, s2, *txt);
+        clock_t end_time = clock();
+
+        const char *source = cache->hits > hits ? "cache hit"
+                           : cache->extensionHits > extensions ? "filtered from a cached prefix" : "text scan";
+        printf("Number of Occurrences: %d (%s)\n", count_fa - before, source);
+        printf("Time taken for search: %.3f milliseconds\n",
+               ((double)(end_time - start_time)) / CLOCKS_PER_SEC * 1000.0);
+    }
+
+    long long lookups = cache->hits + cache->extensionHits + cache->misses;
+    printf("\nCache: %lld hits, %lld prefix extensions, %lld misses (hit rate %.1f%%), %zu of %zu bytes used\n",
+           cache->hits, cache->extensionHits, cache->misses,
+           lookups ? 100.0 * (cache->hits + cache->extensionHits) / lookups : 0.0,
+           cache->bytesUsed, cache->budget);
+    statsCounter("cache_hits", cache->hits);
+    statsCounter("cache_extension_hits", cache->extensionHits);
+    statsCounter("cache_misses", cache->misses);
+    statsCounter("cache_evictions", cache->evictions);
+    statsCounter("cache_invalidations", cache->invalidations);
+    statsCounter("cache_bytes", (long long)cache->bytesUsed);
+    queryCacheFree(cache);
+}
+
+// Incremental search state for auto-suggestion: the automaton and the candidate
+// set both grow by one character per keystroke instead of being rebuilt
+typedef struct {
+    int (*TF)[NO_OF_CHARS];                  // Rows 0..M of the automaton for the current prefix
+    int fallback[MAX_PATTERN_LENGTH + 1];    // fallback[k]: state reached on pat[1..k-1]; row k copies its row
+    char pat[MAX_PATTERN_LENGTH + 1];
+    int M;                                   // Current prefix length
+    int *matchEnds[MAX_PATTERN_LENGTH + 1];  // Per prefix length: text index of the last matched character
+    int matchCount[MAX_PATTERN_LENGTH + 1];
+    char *txt;
+    int N;
+} AutomatonSession;
+
+// Function to start a session with an empty prefix
+int startAutomatonSession(AutomatonSession *session, char *txt) {
+    session->TF = malloc((MAX_PATTERN_LENGTH + 1) * sizeof(*session->TF));
+    if (!session->TF)
+        return 0;
+    fa_table_bytes = (long long)(MAX_PATTERN_LENGTH + 1) * (long long)sizeof(*session->TF);
+    memset(session->TF[0], 0, sizeof(*session->TF)); // Empty pattern: every character stays in state 0
+    session->fallback[0] = 0;
+    session->pat[0] = '\0';
+    session->M = 0;
+    session->matchEnds[0] = NULL;
+    session->matchCount[0] = 0;
+    session->txt = txt;
+    session->N = strlen(txt);
+    return 1;
+}
+
+// Function to extend the prefix by one character.
+// The automaton gains one row copied from its fallback state, O(NO_OF_CHARS), and the
+// candidate set is filtered by one transition per surviving match. Only the first
+// keystroke scans the whole text.
+int appendToAutomatonSession(AutomatonSession *session, char ch) {
+    int M = session->M;
+    unsigned char x = (unsigned char)ch;
+    if (M == MAX_PATTERN_LENGTH)
+        return 0;
+
+    int *ends = (int *)malloc((M == 0 ? session->N : session->matchCount[M]) * sizeof(int) + sizeof(int));
+    if (!ends)
+        return 0;
+
+    // Row M stops being accepting on x, and row M + 1 starts as a copy of its fallback row
+    session->TF[M][x] = M + 1;
+    int fb = (M == 0) ? 0 : session->TF[session->fallback[M]][x];
+    session->fallback[M + 1] = fb;
+    memcpy(session->TF[M + 1], session->TF[fb], sizeof(*session->TF));
+
+    int count = 0;
+    long long transitions = 0;
+    if (M == 0) {
+        int state = 0;
+        for (int i = 0; i < session->N; i++) {
+            state = session->TF[state][(unsigned char)session->txt[i]];
+            if (state == 1)
+                ends[count++] = i;
+        }
+        transitions = session->N;
+    } else {
+        for (int k = 0; k < session->matchCount[M]; k++) {
+            int e = session->matchEnds[M][k] + 1;
+            if (e < session->N && session->TF[M][(unsigned char)session->txt[e]] == M + 1)
+                ends[count++] = e;
+        }
+        transitions = session->matchCount[M];
+    }
+    fa_transitions += transitions;
+
+    session->pat[M] = ch;
+    session->pat[M + 1] = '\0';
+    session->M = M + 1;
+    session->matchEnds[M + 1] = ends;
+    session->matchCount[M + 1] = count;
+    return 1;
+}
+
+// Function to erase the last character: drop its candidate set and restore the old transition
+void backspaceAutomatonSession(AutomatonSession *session) {
+    if (session->M == 0)
+        return;
+    int M = --session->M;
+    unsigned char x = (unsigned char)session->pat[M];
+    free(session->matchEnds[M + 1]);
+    session->TF[M][x] = (M == 0) ? 0 : session->TF[session->fallback[M]][x];
+    session->pat[M] = '\0';
+}
+
+void freeAutomatonSession(AutomatonSession *session) {
+    while (session->M > 0)
+        backspaceAutomatonSession(session);
+    free(session->TF);
+}
+
+// Function to run an interactive session: every character read is a keystroke, '<' erases one
+long long runAutomatonSession(char *txt) {
+    AutomatonSession session;
+    if (!startAutomatonSession(&session, txt)) {
+        printf("Memory allocation failed.\n");
+        return 0;
+    }
+    long long keystrokes = 0;
+    int ch;
+
+    printf("Type the prefix one character at a time ('<' erases the last character):\n");
+    while ((ch = getchar()) != EOF) {
+        if (ch == '\n' || ch == '\r')
+            continue;
+
+        clock_t start_time = clock();
+        if (ch == '<' || ch == '\b' || ch == 127) {
+            backspaceAutomatonSession(&session);
+        } else if (!appendToAutomatonSession(&session, (char)ch)) {
+            printf("Prefix is limited to %d characters.\n", MAX_PATTERN_LENGTH);
+            continue;
+        }
+        clock_t end_time = clock();
+        keystrokes++;
+
+        int M = session.M;
+        printf("Prefix '%s': %d occurrences (%.3f ms)\n", session.pat, session.matchCount[M],
+               ((double)(end_time - start_time) / CLOCKS_PER_SEC) * 1000.0);
+        for (int k = 0; k < session.matchCount[M] && k < SESSION_SUGGESTIONS; k++) {
+            if (!printMatch(txt, session.N, session.matchEnds[M][k], M))
+                break;
+        }
+    }
 
-    // Measure the time taken for the search
-    clock_t start_time = clock();
-    search(s2, s1);
-    clock_t end_time = clock();
+    count_fa = session.matchCount[session.M];
+    freeAutomatonSession(&session);
+    return keystrokes;
+}
+
+int main(int argc, char *argv[]) {
+    int sessionMode = 0;
+    long long cacheBudget = 0; // Bytes for the result cache; 0 answers a single query without it
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--session") == 0) {
+            sessionMode = 1;
+        } else if (strcmp(argv[a], "--cache-bytes") == 0 && a + 1 < argc) {
+            cacheBudget = atoll(argv[++a]);
+        } else if (!statsParseArg(argc, argv, &a)) {
+            printf("Usage: %s [--session] [--cache-bytes N] [--stats] [--stats-json FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    statsBeginPhase("load");
+    char *s1 = NULL;   // Complete text of the file
+    size_t s1_len = 0; // Length of the complete text
+    if (!loadText("sherlock.txt", &s1, &s1_len)) {
+        return 1;
+    }
+    statsEndPhase();
+
+    if (sessionMode) {
+        // Keystroke-by-keystroke search that extends the automaton and filters the previous matches
+        statsBeginPhase("session");
+        long long keystrokes = runAutomatonSession(s1);
+        statsEndPhase();
+        statsCounter("keystrokes", keystrokes);
+    } else if (cacheBudget > 0) {
+        // Repeated queries, answered from the cache where possible
+        statsBeginPhase("queries");
+        runCachedQueries(&s1, &s1_len, (size_t)cacheBudget);
+        statsEndPhase();
+    } else {
+        printf("Enter prefix to search: ");
+        char s2[256];
+        scanf("%s", s2);
+
+        // Measure the time taken for the search
+        statsBeginPhase("search");
+        clock_t start_time = clock();
+        search(s2, s1);
+        clock_t end_time = clock();
+        statsEndPhase();
+
+        // Calculate the elapsed time in milliseconds
+        double time_taken = ((double)(end_time - start_time)) / CLOCKS_PER_SEC * 1000.0;
+        printf("Number of Occurrences: %d\n", count_fa);
+        printf("Time taken for search: %.3f milliseconds\n", time_taken);
+    }
 
-    // Calculate the elapsed time in milliseconds
-    double time_taken = ((double)(end_time - start_time)) / CLOCKS_PER_SEC * 1000.0;
-    printf("Number of Occurrences: %d\n", count_fa);
-    printf("Time taken for search: %.3f milliseconds\n", time_taken);
+    statsCounter("text_bytes", (long long)s1_len);
+    statsCounter("line_table_bytes", (long long)v1_size * (long long)sizeof(long long));
+    statsCounter("dfa_table_bytes", fa_table_bytes);
+    statsCounter("dfa_transitions", fa_transitions);
+    statsCounter("matches", count_fa);
+    statsReport("finite_automata");
 
     free(s1);
     free(v1);
@@ -0,0 +1,368 @@
+#ifndef INGEST_PIPELINE_H
+#define INGEST_PIPELINE_H
+
+// Pipelined file ingest for the index builders. Three stages run concurrently:
+//   reader   - reads the file in large blocks (optionally with O_DIRECT)
+//   splitter - cuts blocks into lines, assigns global line numbers, batches them
+//   builders - one or more threads that insert each batch into the index
+// Stages are connected by bounded queues, so reading, splitting and inserting
+// overlap and memory stays bounded by the queue depths.
+
+// O_DIRECT needs _GNU_SOURCE defined before the first system header of the program,
+// so programs that include other headers first must define it themselves.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INGEST_BLOCK_SIZE (1 << 20)  // Bytes per read
+#define INGEST_BLOCK_ALIGN 4096      // Buffer and size alignment required by O_DIRECT
+#define INGEST_BATCH_LINES 256       // Lines handed to the builders at a time
+#define INGEST_QUEUE_DEPTH 8         // Blocks or batches in flight between two stages
+#define INGEST_MAX_BUILDERS 16
+
+// Inserts one line into the index. With several builders every builder sees every
+// line and must only insert its own share, so that builders never touch the same nodes.
+typedef void (*IngestInsertFn)(void* index, const char* line, int lineNum, int builder, int builders);
+
+// Bounded queue where every consumer receives every item
+typedef struct {
+    void* items[INGEST_QUEUE_DEPTH];
+    long long head;                        // Items pushed so far
+    long long tail[INGEST_MAX_BUILDERS];   // Items taken by each consumer
+    int consumers;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} IngestQueue;
+
+typedef struct {
+    char* data;
+    size_t length;
+} IngestBlock;
+
+typedef struct {
+    const char* lines[INGEST_BATCH_LINES];
+    int lineNums[INGEST_BATCH_LINES];
+    int count;
+    int pending;   // Builders that have not finished with this batch yet
+} IngestBatch;
+
+typedef struct {
+    const char* filename;
+    int directIO;
+    IngestQueue blocks;    // reader -> splitter
+    IngestQueue batches;   // splitter -> builders
+    IngestInsertFn insert;
+    void* index;
+    int builders;
+    char** lines;          // Every line, in file order; returned to the caller
+    int lineCount;
+    int lineCapacity;
+    long long bytesRead;
+    int usedDirectIO;
+    int readerFailed;      // Each flag is written by its own stage only
+    int splitterFailed;
+} IngestPipeline;
+
+typedef struct {
+    IngestPipeline* pipeline;
+    int builder;
+} IngestBuilderArgs;
+
+static void ingestQueueInit(IngestQueue* q, int consumers) {
+    memset(q, 0, sizeof(IngestQueue));
+    q->consumers = consumers;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->notEmpty, NULL);
+    pthread_cond_init(&q->notFull, NULL);
+}
+
+static void ingestQueueDestroy(IngestQueue* q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->notEmpty);
+    pthread_cond_destroy(&q->notFull);
+}
+
+// Function to find how far the slowest consumer is behind; call with the lock held
+static long long ingestQueueSlowest(const IngestQueue* q) {
+    long long slowest = q->tail[0];
+    for (int k = 1; k < q->consumers; k++) {
+        if (q->tail[k] < slowest) slowest = q->tail[k];
+    }
+    return slowest;
+}
+
+// Function to append an item, waiting while the slowest consumer is a full queue behind
+static void ingestQueuePush(IngestQueue* q, void* item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->head - ingestQueueSlowest(q) >= INGEST_QUEUE_DEPTH) {
+        pthread_cond_wait(&q->notFull, &q->lock);
+    }
+    q->items[q->head % INGEST_QUEUE_DEPTH] = item;
+    q->head++;
+    pthread_cond_broadcast(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Function to take the next item for one consumer; NULL once the queue is closed and drained
+static void* ingestQueuePop(IngestQueue* q, int consumer) {
+    pthread_mutex_lock(&q->lock);
+    while (q->tail[consumer] == q->head && !q->closed) {
+        pthread_cond_wait(&q->notEmpty, &q->lock);
+    }
+    void* item = NULL;
+    if (q->tail[consumer] < q->head) {
+        item = q->items[q->tail[consumer] % INGEST_QUEUE_DEPTH];
+        q->tail[consumer]++;
+        pthread_cond_broadcast(&q->notFull);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+static void ingestQueueClose(IngestQueue* q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Function to open the input, trying O_DIRECT first when asked for
+static int ingestOpen(IngestPipeline* p) {
+#ifdef O_DIRECT
+    if (p->directIO) {
+        int fd = open(p->filename, O_RDONLY | O_DIRECT);
+        if (fd >= 0) {
+            p->usedDirectIO = 1;
+            return fd;
+        }
+    }
+#endif
+    return open(p->filename, O_RDONLY);
+}
+
+// Reader stage: large aligned block reads, handed to the splitter
+static void* ingestReader(void* arg) {
+    IngestPipeline* p = (IngestPipeline*)arg;
+    int fd = ingestOpen(p);
+    if (fd < 0) {
+        perror("Unable to open file");
+        p->readerFailed = 1;
+        ingestQueueClose(&p->blocks);
+        return NULL;
+    }
+
+    for (;;) {
+        IngestBlock* block = (IngestBlock*)malloc(sizeof(IngestBlock));
+        void* data = NULL;
+        if (!block || posix_memalign(&data, INGEST_BLOCK_ALIGN, INGEST_BLOCK_SIZE) != 0) {
+            printf("Memory allocation failed.\n");
+            free(block);
+            p->readerFailed = 1;
+            break;
+        }
+        ssize_t got = read(fd, data, INGEST_BLOCK_SIZE);
+        if (got < 0 && p->usedDirectIO) {
+            // The file system refused O_DIRECT: reopen buffered and retry this block from where
+            // the last one ended, so blocks already handed on are not read a second time
+            close(fd);
+            p->usedDirectIO = 0;
+            p->directIO = 0;
+            fd = ingestOpen(p);
+            if (fd >= 0 && lseek(fd, (off_t)p->bytesRead, SEEK_SET) < 0) {
+                close(fd);
+                fd = -1;
+            }
+            got = fd >= 0 ? read(fd, data, INGEST_BLOCK_SIZE) : -1;
+        }
+        if (got <= 0) {
+            if (got < 0) {
+                perror("Unable to read file");
+                p->readerFailed = 1;
+            }
+            free(data);
+            free(block);
+            break;
+        }
+        block->data = (char*)data;
+        block->length = (size_t)got;
+        p->bytesRead += got;
+        ingestQueuePush(&p->blocks, block);
+    }
+
+    if (fd >= 0) close(fd);
+    ingestQueueClose(&p->blocks);
+    return NULL;
+}
+
+// Function to store a finished line and add it to the batch being filled
+static int ingestEmitLine(IngestPipeline* p, IngestBatch** batch, const char* text, size_t length) {
+    if (p->lineCount == p->lineCapacity) {
+        int capacity = p->lineCapacity ? p->lineCapacity * 2 : 1024;
+        char** grown = (char**)realloc(p->lines, capacity * sizeof(char*));
+        if (!grown) return 0;
+        p->lines = grown;
+        p->lineCapacity = capacity;
+    }
+    if (!*batch) {
+        *batch = (IngestBatch*)calloc(1, sizeof(IngestBatch));
+        if (!*batch) return 0;
+    }
+    char* line = (char*)malloc(length + 1);
+    if (!line) return 0;
+    memcpy(line, text, length);
+    line[length] = '\0';
+    p->lines[p->lineCount] = line;
+
+    (*batch)->lines[(*batch)->count] = line;
+    (*batch)->lineNums[(*batch)->count] = p->lineCount;
+    (*batch)->count++;
+    p->lineCount++;
+
+    if ((*batch)->count == INGEST_BATCH_LINES) {
+        (*batch)->pending = p->builders;
+        ingestQueuePush(&p->batches, *batch);
+        *batch = NULL;
+    }
+    return 1;
+}
+
+// Splitter stage: cuts blocks into lines, carrying partial lines across block boundaries
+static void* ingestSplitter(void* arg) {
+    IngestPipeline* p = (IngestPipeline*)arg;
+    IngestBatch* batch = NULL;
+    char* carry = NULL;       // Start of a line that continues into the next block
+    size_t carryLength = 0;
+    IngestBlock* block;
+
+    while ((block = (IngestBlock*)ingestQueuePop(&p->blocks, 0)) != NULL) {
+        size_t pos = 0;
+        while (!p->splitterFailed && pos < block->length) {
+            char* newline = (char*)memchr(block->data + pos, '\n', block->length - pos);
+            size_t end = newline ? (size_t)(newline - block->data) : block->length;
+            size_t length = end - pos;
+
+            if (carryLength > 0 || !newline) {
+                char* grown = (char*)realloc(carry, carryLength + length + 1);
+                if (!grown) {
+                    p->splitterFailed = 1;
+                    break;
+                }
+                carry = grown;
+                memcpy(carry + carryLength, block->data + pos, length);
+                carryLength += length;
+                if (newline) {
+                    if (!ingestEmitLine(p, &batch, carry, carryLength)) p->splitterFailed = 1;
+                    carryLength = 0;
+                }
+            } else if (!ingestEmitLine(p, &batch, block->data + pos, length)) {
+                p->splitterFailed = 1;
+            }
+            pos = end + 1;
+        }
+        free(block->data);
+        free(block);
+    }
+
+    // The last line may have no trailing newline
+    if (!p->splitterFailed && carryLength > 0 && !ingestEmitLine(p, &batch, carry, carryLength)) {
+        p->splitterFailed = 1;
+    }
+    if (p->splitterFailed) {
+        printf("Memory allocation failed.\n");
+    }
+    if (batch) {
+        batch->pending = p->builders;
+        ingestQueuePush(&p->batches, batch);
+    }
+    free(carry);
+    ingestQueueClose(&p->batches);
+    return NULL;
+}
+
+// Builder stage: inserts this builder's share of every batch; the last builder frees it
+static void* ingestBuilder(void* arg) {
+    IngestBuilderArgs* args = (IngestBuilderArgs*)arg;
+    IngestPipeline* p = args->pipeline;
+    IngestBatch* batch;
+
+    while ((batch = (IngestBatch*)ingestQueuePop(&p->batches, args->builder)) != NULL) {
+        for (int k = 0; k < batch->count; k++) {
+            p->insert(p->index, batch->lines[k], batch->lineNums[k], args->builder, p->builders);
+        }
+        if (__atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+            free(batch);
+        }
+    }
+    return NULL;
+}
+
+// Function to read a file and build an index from it with the pipeline above.
+// Returns the lines in file order (the caller frees them), or NULL on failure.
+static char** ingestFile(const char* filename, IngestInsertFn insert, void* index, int builders,
+                         int directIO, int* lineCount) {
+    IngestPipeline p;
+    memset(&p, 0, sizeof(p));
+    if (builders < 1) builders = 1;
+    if (builders > INGEST_MAX_BUILDERS) builders = INGEST_MAX_BUILDERS;
+    p.filename = filename;
+    p.directIO = directIO;
+    p.insert = insert;
+    p.index = index;
+    p.builders = builders;
+    ingestQueueInit(&p.blocks, 1);
+    ingestQueueInit(&p.batches, builders);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t reader, splitter, builderThreads[INGEST_MAX_BUILDERS];
+    IngestBuilderArgs builderArgs[INGEST_MAX_BUILDERS];
+    pthread_create(&reader, NULL, ingestReader, &p);
+    pthread_create(&splitter, NULL, ingestSplitter, &p);
+    for (int b = 0; b < builders; b++) {
+        builderArgs[b].pipeline = &p;
+        builderArgs[b].builder = b;
+        pthread_create(&builderThreads[b], NULL, ingestBuilder, &builderArgs[b]);
+    }
+
+    pthread_join(reader, NULL);
+    pthread_join(splitter, NULL);
+    for (int b = 0; b < builders; b++) {
+        pthread_join(builderThreads[b], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ingestQueueDestroy(&p.blocks);
+    ingestQueueDestroy(&p.batches);
+
+    if (p.readerFailed || p.splitterFailed) {
+        for (int i = 0; i < p.lineCount; i++) {
+            free(p.lines[i]);
+        }
+        free(p.lines);
+        return NULL;
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Ingested %lld bytes, %d lines in %.2f ms (%.2f MB/s, %d builder%s%s)\n",
+           p.bytesRead, p.lineCount, seconds * 1000,
+           seconds > 0 ? p.bytesRead / seconds / 1e6 : 0.0,
+           builders, builders == 1 ? "" : "s", p.usedDirectIO ? ", O_DIRECT" : "");
+
+    *lineCount = p.lineCount;
+    if (!p.lines) {
+        p.lines = (char**)malloc(sizeof(char*)); // Empty file: still hand back an array
+    }
+    return p.lines;
+}
+
+#endif
@@ -2,11 +2,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h> // For measuring execution time
+#include "Stats.h"  // Optional --stats instrumentation
+#include "QueryCache.h" // Result cache for repeated queries (--cache-bytes)
 
 // Dynamic array to store positions of line breaks in the text
 long long *v1 = NULL;
 int v1_size = 0;      // Number of lines in the file
 int count_kmp = 0;    // Counter for pattern occurrences
+long long kmp_comparisons = 0;   // Character comparisons made by KMPSearch
+long long kmp_lps_fallbacks = 0; // Times a mismatch fell back through the LPS array
+unsigned long long text_generation = 0; // Bumped by loadText, keys the result cache
 
 // Function to compute the Longest Prefix Suffix (LPS) array for the pattern
 void computeLPSArray(char *pat, int M, int *lps) {
@@ -30,16 +35,63 @@ void computeLPSArray(char *pat, int M, int *lps) {
     }
 }
 
-// Function to search for occurrences of the pattern in the text using KMP algorithm
-void KMPSearch(char *pat, char *txt) {
+// Function to print one match with its line, position and the word containing it
+int printKMPMatch(char *txt, int N, int matchStart, int M) {
+    // Calculate line number and position within that line
+    long long it = 0;
+    while (it < v1_size && v1[it] <= matchStart)
+        it++;
+
+    int c;
+    if (it == 0) {
+        c = matchStart;
+    } else {
+        c = matchStart - v1[it - 1];
+    }
+    if (it == 0) {
+        c++;
+    }
+
+    // Identify the start and end of the word containing the matched pattern
+    int start = matchStart;
+    while (start > 0 && txt[start - 1] != ' ')
+        start--;
+
+    int end = matchStart + M;
+    while (end < N && txt[end] != ' ')
+        end++;
+
+    // Extract the matched word
+    int word_len = end - start;
+    char *word = (char *)malloc(word_len + 1);
+    if (!word) {
+        printf("Memory allocation failed.\n");
+        return 0;
+    }
+    strncpy(word, txt + start, word_len);
+    word[word_len] = '\0';
+
+    // Print the result
+    printf("Found '%s' at line: %lld position: %d\n", word, it + 1, c);
+
+    free(word);
+    return 1;
+}
+
+// Function to collect the start offsets of all occurrences of the pattern using KMP algorithm
+int *KMPFindAll(char *pat, char *txt, int *matchCount) {
     int M = strlen(pat);  // Length of the pattern
     int N = strlen(txt);  // Length of the text
+    int capacity = 16;    // Grows by doubling as matches are found
+    int *matches = (int *)malloc(capacity * sizeof(int));
 
     // Allocate memory for LPS array
     int *lps = (int *)malloc(M * sizeof(int));
-    if (!lps) {
+    if (!lps || !matches) {
         printf("Memory allocation failed.\n");
-        return;
+        free(lps);
+        free(matches);
+        return NULL;
     }
 
     // Preprocess the pattern to fill the LPS array
@@ -47,83 +99,92 @@ void KMPSearch(char *pat, char *txt) {
 
     int i = 0; // Index for txt
     int j = 0; // Index for pat
+    int count = 0;
+    long long comparisons = 0, fallbacks = 0; // Kept local so the loop stays in registers
 
     while ((N - i) >= (M - j)) { // Continue until text has remaining characters to match
+        int matched = 0;
+        comparisons++;
         if (pat[j] == txt[i]) { // Characters match
             j++;
             i++;
+            matched = 1;
         }
 
         if (j == M) { // Pattern found
-            // Calculate line number and position within that line
-            long long it = 0;
-            while (it < v1_size && v1[it] <= i - j)
-                it++;
-
-            int c;
-            if (it == 0) {
-                c = i - j;
-            } else {
-                c = i - j - v1[it - 1];
-            }
-            if (it == 0) {
-                c++;
-            }
-
-            // Identify the start and end of the word containing the matched pattern
-            int start = i - j;
-            while (start > 0 && txt[start - 1] != ' ')
-                start--;
-
-            int end = i;
-            while (end < N && txt[end] != ' ')
-                end++;
-
-            // Extract the matched word
-            int word_len = end - start;
-            char *word = (char *)malloc(word_len + 1);
-            if (!word) {
-                printf("Memory allocation failed.\n");
-                free(lps);
-                return;
+            if (count == capacity) {
+                capacity *= 2;
+                int *grown = (int *)realloc(matches, capacity * sizeof(int));
+                if (!grown) {
+                    printf("Memory allocation failed.\n");
+                    free(matches);
+                    free(lps);
+                    kmp_comparisons += comparisons;
+                    kmp_lps_fallbacks += fallbacks;
+                    return NULL;
+                }
+                matches = grown;
             }
-            strncpy(word, txt + start, word_len);
-            word[word_len] = '\0';
-
-            // Print the result
-            count_kmp++;
-            printf("Found '%s' at line: %lld position: %d\n", word, it + 1, c);
-
-            free(word);
+            matches[count++] = i - j;
             j = lps[j - 1]; // Move to the next possible match using LPS array
-        } else if (i < N && pat[j] != txt[i]) { // Mismatch after j matches
-            if (j != 0) {
-                j = lps[j - 1]; // Use LPS array to skip unnecessary comparisons
-            } else {
-                i++; // Move to the next character in text
+        } else if (i < N) {
+            comparisons += matched; // After a match this is a new pair; after a mismatch it was counted above
+            if (pat[j] != txt[i]) { // Mismatch after j matches
+                if (j != 0) {
+                    j = lps[j - 1]; // Use LPS array to skip unnecessary comparisons
+                    fallbacks++;
+                } else {
+                    i++; // Move to the next character in text
+                }
             }
         }
     }
 
     free(lps); // Free allocated memory for LPS array
+    kmp_comparisons += comparisons;
+    kmp_lps_fallbacks += fallbacks;
+    *matchCount = count;
+    return matches;
 }
 
-int main() {
-    FILE *newfile = fopen("sherlock.txt", "r");
+// Function to search for occurrences of the pattern in the text and print each of them
+void KMPSearch(char *pat, char *txt) {
+    int count = 0;
+    int *matches = KMPFindAll(pat, txt, &count);
+    if (!matches) {
+        return;
+    }
+
+    int M = strlen(pat);
+    int N = strlen(txt);
+    for (int k = 0; k < count; k++) {
+        count_kmp++;
+        if (!printKMPMatch(txt, N, matches[k], M))
+            break;
+    }
+    free(matches);
+}
+
+// Function to (re)load the text into `*text`, rebuilding the line table `v1`.
+// Every successful load bumps text_generation so cached results for the old text are dropped.
+int loadText(const char *filename, char **text, size_t *length) {
+    FILE *newfile = fopen(filename, "r");
     if (!newfile) {
         printf("Failed to open the file.\n");
-        return 1;
+        return 0;
     }
 
     char *s1 = NULL;           // Complete text of the file
     size_t s1_len = 0;         // Length of the complete text
+    long long *lines = NULL;   // Cumulative line ends, becomes v1
+    int lineCount = 0;
     size_t buffer_size = 1024; // Buffer size for reading lines
     char *buffer = (char *)malloc(buffer_size); // Buffer to hold each line
 
     if (!buffer) {
         printf("Memory allocation failed.\n");
         fclose(newfile);
-        return 1;
+        return 0;
     }
 
     // Read the file line by line and accumulate the content in `s1`
@@ -131,12 +192,17 @@ int main() {
         size_t line_len = strlen(buffer);
 
         // Resize `s1` to fit the new line, a space, and null terminator
-        s1 = realloc(s1, s1_len + line_len + 2); // +2 for space and null terminator
-        if (!s1) {
+        char *grown = realloc(s1, s1_len + line_len + 2); // +2 for space and null terminator
+        long long *grownLines = grown ? realloc(lines, (lineCount + 1) * sizeof(long long)) : NULL;
+        if (grown) s1 = grown;
+        if (grownLines) lines = grownLines;
+        if (!grown || !grownLines) {
             printf("Memory allocation failed.\n");
+            free(s1);
+            free(lines);
             free(buffer);
             fclose(newfile);
-            return 1;
+            return 0;
         }
 
         // Append the line to `s1`
@@ -146,42 +212,156 @@ int main() {
         s1_len++;
         s1[s1_len] = '\0';
 
-        // Store cumulative length of each line in `v1` for line break positions
-        v1 = realloc(v1, (v1_size + 1) * sizeof(long long));
-        if (!v1) {
-            printf("Memory allocation failed.\n");
-            free(s1);
-            free(buffer);
-            fclose(newfile);
-            return 1;
-        }
-
-        if (v1_size == 0) {
-            v1[v1_size] = line_len;
+        // Store cumulative length of each line for line break positions
+        if (lineCount == 0) {
+            lines[lineCount] = line_len;
         } else {
-            v1[v1_size] = v1[v1_size - 1] + line_len + 1;
+            lines[lineCount] = lines[lineCount - 1] + line_len + 1;
         }
-        v1_size++;
+        lineCount++;
     }
 
     fclose(newfile);
     free(buffer);
 
-    // Read the pattern to search for
+    free(*text);
+    free(v1);
+    *text = s1;
+    *length = s1_len;
+    v1 = lines;
+    v1_size = lineCount;
+    text_generation++;
+    return 1;
+}
+
+// Function to answer a query through the result cache, scanning the text only on a miss
+void cachedKMPSearch(QueryCache *cache, char *pat, char *txt) {
+    int M = strlen(pat);
+    int N = strlen(txt);
+    queryCacheBindText(cache, txt, N, text_generation);
+
+    QueryCacheEntry *entry = queryCacheLookup(cache, pat);
+    if (!entry) {
+        int count = 0;
+        int *matches = KMPFindAll(pat, txt, &count);
+        if (!matches) {
+            return;
+        }
+        entry = queryCacheInsert(cache, pat, matches, count);
+        if (!entry) {
+            printf("Memory allocation failed.\n");
+            return;
+        }
+    }
+
+    for (int k = 0; k < entry->count; k++) {
+        count_kmp++;
+        if (!printKMPMatch(txt, N, entry->positions[k], M))
+            break;
+    }
+}
+
+// Function to answer patterns until EOF or an empty line, reusing earlier results through the cache;
+// ":reload" re-reads the text
+void runCachedQueries(char **txt, size_t *length, size_t budget) {
+    QueryCache *cache = queryCacheCreate(budget);
+    if (!cache) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+
     char s2[256];
-    printf("Enter pattern to search: ");
-    fgets(s2, sizeof(s2), stdin);
-    s2[strcspn(s2, "\n")] = '\0'; // Remove newline character
-
-    // Measure the execution time for searching the pattern
-    clock_t start = clock();
-    KMPSearch(s2, s1);
-    clock_t end = clock();
-
-    // Print the total number of occurrences and execution time
-    printf("Number of Occurrences: %d\n", count_kmp);
-    double time_taken = ((double)(end - start) / CLOCKS_PER_SEC) * 1000; // Time in milliseconds
-    printf("Execution time: %.2f ms\n", time_taken);
+    while (1) {
+        printf("Enter pattern to search (empty line to stop): ");
+        if (!fgets(s2, sizeof(s2), stdin))
+            break;
+        s2[strcspn(s2, "\n")] = '\0'; // Remove newline character
+        if (s2[0] == '\0')
+            break;
+        if (strcmp(s2, ":reload") == 0) {
+            // The text may have changed on disk: re-read it, which invalidates the cache
+            if (loadText("sherlock.txt", txt, length))
+                printf("Reloaded sherlock.txt (%zu bytes), cached results dropped\n", *length);
+            continue;
+        }
+
+        long long hits = cache->hits, extensions = cache->extensionHits;
+        int before = count_kmp;
+        clock_t start = clock();
+        cachedKMPSearch(cache, s2, *txt);
+        clock_t end = clock();
+
+        const char *source = cache->hits > hits ? "cache hit"
+                           : cache->extensionHits > extensions ? "filtered from a cached prefix" : "text scan";
+        printf("Number of Occurrences: %d (%s)\n", count_kmp - before, source);
+        printf("Execution time: %.2f ms\n", ((double)(end - start) / CLOCKS_PER_SEC) * 1000);
+    }
+
+    long long lookups = cache->hits + cache->extensionHits + cache->misses;
+    printf("Cache: %lld hits, %lld prefix extensions, %lld misses (hit rate %.1f%%), %zu of %zu bytes used\n",
+           cache->hits, cache->extensionHits, cache->misses,
+           lookups ? 100.0 * (cache->hits + cache->extensionHits) / lookups : 0.0,
+           cache->bytesUsed, cache->budget);
+    statsCounter("cache_hits", cache->hits);
+    statsCounter("cache_extension_hits", cache->extensionHits);
+    statsCounter("cache_misses", cache->misses);
+    statsCounter("cache_evictions", cache->evictions);
+    statsCounter("cache_invalidations", cache->invalidations);
+    statsCounter("cache_bytes", (long long)cache->bytesUsed);
+    queryCacheFree(cache);
+}
+
+int main(int argc, char *argv[]) {
+    long long cacheBudget = 0; // Bytes for the result cache; 0 answers a single query without it
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--cache-bytes") == 0 && a + 1 < argc) {
+            cacheBudget = atoll(argv[++a]);
+        } else if (!statsParseArg(argc, argv, &a)) {
+            printf("Usage: %s [--cache-bytes N] [--stats] [--stats-json FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    statsBeginPhase("load");
+    char *s1 = NULL;   // Complete text of the file
+    size_t s1_len = 0; // Length of the complete text
+    if (!loadText("sherlock.txt", &s1, &s1_len)) {
+        return 1;
+    }
+    statsEndPhase();
+
+    char s2[256] = "";
+    if (cacheBudget > 0) {
+        // Repeated queries, answered from the cache where possible
+        statsBeginPhase("queries");
+        runCachedQueries(&s1, &s1_len, (size_t)cacheBudget);
+        statsEndPhase();
+    } else {
+        // Read the pattern to search for
+        printf("Enter pattern to search: ");
+        fgets(s2, sizeof(s2), stdin);
+        s2[strcspn(s2, "\n")] = '\0'; // Remove newline character
+
+        // Measure the execution time for searching the pattern
+        statsBeginPhase("search");
+        clock_t start = clock();
+        KMPSearch(s2, s1);
+        clock_t end = clock();
+        statsEndPhase();
+
+        // Print the total number of occurrences and execution time
+        printf("Number of Occurrences: %d\n", count_kmp);
+        double time_taken = ((double)(end - start) / CLOCKS_PER_SEC) * 1000; // Time in milliseconds
+        printf("Execution time: %.2f ms\n", time_taken);
+    }
+
+    statsCounter("text_bytes", (long long)s1_len);
+    statsCounter("line_table_bytes", (long long)v1_size * (long long)sizeof(long long));
+    statsCounter("lps_bytes", (long long)strlen(s2) * (long long)sizeof(int));
+    statsCounter("comparisons", kmp_comparisons);
+    statsCounter("lps_fallbacks", kmp_lps_fallbacks);
+    statsCounter("matches", count_kmp);
+    statsReport("kmp");
 
     // Free allocated memory
     free(s1);
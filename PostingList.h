@@ -0,0 +1,201 @@
+#ifndef POSTING_LIST_H
+#define POSTING_LIST_H
+
+// Sorted, duplicate-free lists of line IDs for multi-term queries.
+// IDs are stored as varint-encoded gaps. Every POSTING_BLOCK IDs a skip entry
+// records where the block starts, so an iterator can gallop over whole blocks
+// instead of decoding them. Intersecting a short list with a long one then costs
+// about |short| * log(|long| / |short|) rather than |long|.
+
+#include <stdlib.h>
+#include <string.h>
+
+#define POSTING_BLOCK 64  // IDs per skip entry
+
+typedef struct {
+    unsigned char* bytes;   // Varint gaps
+    size_t byteCount;
+    size_t byteCapacity;
+    int count;              // Number of IDs
+    int last;               // Last ID appended, -1 when empty
+    int* skipFirst;         // First ID of each block
+    int* skipBase;          // ID preceding each block (-1 for the first), the base of its first gap
+    size_t* skipOffset;     // Byte offset of each block
+    int skipCount;
+    int skipCapacity;
+} PostingList;
+
+// Cursor over a posting list; current is -1 before the first and after the last ID
+typedef struct {
+    const PostingList* list;
+    size_t offset;          // Byte offset of the next gap
+    int index;              // Position of current within the list
+    int current;
+} PostingIterator;
+
+static void postingInit(PostingList* list) {
+    memset(list, 0, sizeof(PostingList));
+    list->last = -1;
+}
+
+static void postingFree(PostingList* list) {
+    free(list->bytes);
+    free(list->skipFirst);
+    free(list->skipBase);
+    free(list->skipOffset);
+    postingInit(list);
+}
+
+// Function to append an ID; IDs must arrive in ascending order and repeats are ignored
+static int postingAppend(PostingList* list, int id) {
+    if (id <= list->last) return 1;
+
+    if (list->count % POSTING_BLOCK == 0) {
+        if (list->skipCount == list->skipCapacity) {
+            int capacity = list->skipCapacity ? list->skipCapacity * 2 : 16;
+            int* first = (int*)realloc(list->skipFirst, capacity * sizeof(int));
+            if (first) list->skipFirst = first;
+            int* base = (int*)realloc(list->skipBase, capacity * sizeof(int));
+            if (base) list->skipBase = base;
+            size_t* offset = (size_t*)realloc(list->skipOffset, capacity * sizeof(size_t));
+            if (offset) list->skipOffset = offset;
+            if (!first || !base || !offset) return 0;
+            list->skipCapacity = capacity;
+        }
+        list->skipFirst[list->skipCount] = id;
+        list->skipBase[list->skipCount] = list->last;
+        list->skipOffset[list->skipCount] = list->byteCount;
+        list->skipCount++;
+    }
+
+    if (list->byteCount + 5 > list->byteCapacity) {
+        size_t capacity = list->byteCapacity ? list->byteCapacity * 2 : 64;
+        unsigned char* grown = (unsigned char*)realloc(list->bytes, capacity);
+        if (!grown) return 0;
+        list->bytes = grown;
+        list->byteCapacity = capacity;
+    }
+    unsigned int gap = (unsigned int)(id - list->last);
+    while (gap >= 0x80) {
+        list->bytes[list->byteCount++] = (unsigned char)(gap | 0x80);
+        gap >>= 7;
+    }
+    list->bytes[list->byteCount++] = (unsigned char)gap;
+
+    list->last = id;
+    list->count++;
+    return 1;
+}
+
+static void postingIterStart(PostingIterator* it, const PostingList* list) {
+    it->list = list;
+    it->offset = 0;
+    it->index = -1;
+    it->current = -1;
+}
+
+// Function to move to the next ID; returns it, or -1 at the end
+static int postingIterNext(PostingIterator* it) {
+    const PostingList* list = it->list;
+    if (it->index + 1 >= list->count) {
+        it->index = list->count;
+        it->current = -1;
+        return -1;
+    }
+    unsigned int gap = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = list->bytes[it->offset++];
+        gap |= (unsigned int)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    int base = it->index < 0 ? -1 : it->current;
+    it->index++;
+    it->current = base + (int)gap;
+    return it->current;
+}
+
+// Function to move to the first ID >= target; returns it, or -1 if there is none.
+// Whole blocks are skipped by galloping over the skip entries, then at most one
+// block is decoded.
+static int postingIterAdvanceTo(PostingIterator* it, int target) {
+    const PostingList* list = it->list;
+    if (it->index >= list->count) return -1;
+    if (it->index >= 0 && it->current >= target) return it->current;
+
+    int block = it->index < 0 ? 0 : it->index / POSTING_BLOCK;
+    if (block + 1 < list->skipCount && list->skipFirst[block + 1] <= target) {
+        // Exponential search for the last block whose first ID is <= target
+        int low = block + 1, step = 1;
+        while (low + step < list->skipCount && list->skipFirst[low + step] <= target) {
+            low += step;
+            step *= 2;
+        }
+        int high = low + step < list->skipCount ? low + step : list->skipCount;
+        while (high - low > 1) {
+            int mid = (low + high) / 2;
+            if (list->skipFirst[mid] <= target) {
+                low = mid;
+            } else {
+                high = mid;
+            }
+        }
+        // Position the cursor just before that block
+        it->offset = list->skipOffset[low];
+        it->index = low * POSTING_BLOCK - 1;
+        it->current = list->skipBase[low];
+    }
+
+    int id;
+    while ((id = postingIterNext(it)) >= 0 && id < target) {
+    }
+    return id;
+}
+
+// Function to intersect two lists into out, galloping through the longer one
+static int postingIntersect(const PostingList* a, const PostingList* b, PostingList* out) {
+    if (a->count > b->count) {
+        const PostingList* swap = a;
+        a = b;
+        b = swap;
+    }
+    postingInit(out);
+
+    PostingIterator small, large;
+    postingIterStart(&small, a);
+    postingIterStart(&large, b);
+    int id;
+    while ((id = postingIterNext(&small)) >= 0) {
+        int found = postingIterAdvanceTo(&large, id);
+        if (found < 0) break;
+        if (found == id && !postingAppend(out, id)) return 0;
+    }
+    return 1;
+}
+
+// Function to merge two lists into out
+static int postingUnion(const PostingList* a, const PostingList* b, PostingList* out) {
+    postingInit(out);
+
+    PostingIterator x, y;
+    postingIterStart(&x, a);
+    postingIterStart(&y, b);
+    int u = postingIterNext(&x), v = postingIterNext(&y);
+    while (u >= 0 || v >= 0) {
+        int id;
+        if (v < 0 || (u >= 0 && u <= v)) {
+            id = u;
+            if (u == v) v = postingIterNext(&y);
+            u = postingIterNext(&x);
+        } else {
+            id = v;
+            v = postingIterNext(&y);
+        }
+        if (!postingAppend(out, id)) return 0;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+// Memory-bounded cache of query results (pattern -> match start offsets) for
+// programs that answer repeated queries over one text. A pattern that extends
+// a cached pattern is answered by filtering the cached offsets against the text
+// instead of scanning the whole text again. Entries are replaced with CLOCK
+// once the byte budget or the slot table is full.
+
+#include <stdlib.h>
+#include <string.h>
+
+#define QUERY_CACHE_SLOTS 1024
+#define QUERY_CACHE_BUCKETS 2048  // Power of two, used as a hash mask
+
+// One cached result
+typedef struct {
+    char* pattern;
+    int* positions;     // Match start offsets in the text, ascending
+    int count;          // Number of offsets
+    size_t bytes;       // Memory charged against the budget
+    unsigned hash;      // Hash of the pattern
+    int next;           // Next slot in the same bucket, -1 at the end of the chain
+    int used;
+    int referenced;     // CLOCK bit, set on insert and on every hit
+} QueryCacheEntry;
+
+typedef struct {
+    QueryCacheEntry slots[QUERY_CACHE_SLOTS];
+    int buckets[QUERY_CACHE_BUCKETS];   // First slot of each hash chain, -1 if empty
+    QueryCacheEntry overflow;           // Holds the last result too large to cache
+    int hand;                           // CLOCK hand
+    int usedSlots;
+    size_t budget;                      // Byte budget for all entries
+    size_t bytesUsed;
+    const char* text;                   // Text the cached offsets refer to
+    int textLength;
+    unsigned long long textGeneration;  // Version of the text the offsets were computed on
+    long long hits;                     // Exact pattern found
+    long long extensionHits;            // Answered by filtering a cached prefix
+    long long misses;                   // Caller had to scan the text
+    long long evictions;
+    long long invalidations;
+} QueryCache;
+
+// Function to create an empty cache with the given byte budget
+static QueryCache* queryCacheCreate(size_t budget) {
+    QueryCache* cache = (QueryCache*)calloc(1, sizeof(QueryCache));
+    if (!cache) return NULL;
+    for (int b = 0; b < QUERY_CACHE_BUCKETS; b++) {
+        cache->buckets[b] = -1;
+    }
+    cache->budget = budget;
+    return cache;
+}
+
+// FNV-1a, one character at a time so that all prefix hashes come out of one pass
+static unsigned queryCacheHashStep(unsigned hash, char character) {
+    return (hash ^ (unsigned char)character) * 16777619u;
+}
+
+#define QUERY_CACHE_HASH_SEED 2166136261u
+
+// Function to find the slot holding the first len characters of pat, or -1
+static int queryCacheFind(const QueryCache* cache, const char* pat, int len, unsigned hash) {
+    for (int s = cache->buckets[hash & (QUERY_CACHE_BUCKETS - 1)]; s >= 0; s = cache->slots[s].next) {
+        const QueryCacheEntry* e = &cache->slots[s];
+        if (e->hash == hash && (int)strlen(e->pattern) == len && memcmp(e->pattern, pat, len) == 0) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+// Function to drop one slot and release its memory
+static void queryCacheRemove(QueryCache* cache, int slot) {
+    QueryCacheEntry* e = &cache->slots[slot];
+    int* link = &cache->buckets[e->hash & (QUERY_CACHE_BUCKETS - 1)];
+    while (*link != slot) {
+        link = &cache->slots[*link].next;
+    }
+    *link = e->next;
+
+    cache->bytesUsed -= e->bytes;
+    cache->usedSlots--;
+    free(e->pattern);
+    free(e->positions);
+    memset(e, 0, sizeof(QueryCacheEntry));
+}
+
+// Function to drop every cached result, e.g. after the text has changed
+static void queryCacheInvalidate(QueryCache* cache) {
+    for (int s = 0; s < QUERY_CACHE_SLOTS; s++) {
+        if (cache->slots[s].used) queryCacheRemove(cache, s);
+    }
+    cache->invalidations++;
+}
+
+// Function to tie the cache to a version of the text. The caller bumps generation whenever
+// it reloads or edits the text (even in place), and all cached offsets are then dropped.
+static void queryCacheBindText(QueryCache* cache, const char* text, int textLength, unsigned long long generation) {
+    if (cache->textGeneration != generation) {
+        if (cache->usedSlots > 0) queryCacheInvalidate(cache);
+        cache->textGeneration = generation;
+    }
+    cache->text = text;
+    cache->textLength = textLength;
+}
+
+// Function to evict the first unreferenced entry under the CLOCK hand
+static void queryCacheEvictOne(QueryCache* cache) {
+    for (;;) {
+        int slot = cache->hand;
+        QueryCacheEntry* e = &cache->slots[slot];
+        cache->hand = (cache->hand + 1) % QUERY_CACHE_SLOTS;
+        if (!e->used) continue;
+        if (e->referenced) {
+            e->referenced = 0;
+            continue;
+        }
+        queryCacheRemove(cache, slot);
+        cache->evictions++;
+        return;
+    }
+}
+
+// Function to store a result; the cache takes ownership of positions.
+// Returns the stored entry, valid until the next call on the cache, or NULL on allocation failure.
+static QueryCacheEntry* queryCacheInsert(QueryCache* cache, const char* pat, int* positions, int count) {
+    // The previous oversized result is only valid until this call
+    free(cache->overflow.positions);
+    cache->overflow.positions = NULL;
+    cache->overflow.count = 0;
+
+    size_t len = strlen(pat);
+    size_t bytes = sizeof(QueryCacheEntry) + len + 1 + (size_t)count * sizeof(int);
+
+    // Results larger than the whole budget are handed back without being cached
+    if (bytes > cache->budget) {
+        cache->overflow.positions = positions;
+        cache->overflow.count = count;
+        return &cache->overflow;
+    }
+
+    // Callers hand over arrays with spare capacity. Copy into an exact-size block so the bytes
+    // charged are the bytes held (shrinking with realloc can keep a large block's pages).
+    int* exact = NULL;
+    if (count > 0) {
+        exact = (int*)malloc((size_t)count * sizeof(int));
+        if (!exact) {
+            free(positions);
+            return NULL;
+        }
+        memcpy(exact, positions, (size_t)count * sizeof(int));
+    }
+    free(positions);
+    positions = exact;
+
+    char* copy = (char*)malloc(len + 1);
+    if (!copy) {
+        free(positions);
+        return NULL;
+    }
+    memcpy(copy, pat, len + 1);
+
+    while (cache->usedSlots > 0 &&
+           (cache->bytesUsed + bytes > cache->budget || cache->usedSlots == QUERY_CACHE_SLOTS)) {
+        queryCacheEvictOne(cache);
+    }
+    int slot = cache->hand;
+    while (cache->slots[slot].used) {
+        slot = (slot + 1) % QUERY_CACHE_SLOTS;
+    }
+
+    unsigned hash = QUERY_CACHE_HASH_SEED;
+    for (size_t i = 0; i < len; i++) {
+        hash = queryCacheHashStep(hash, pat[i]);
+    }
+
+    QueryCacheEntry* e = &cache->slots[slot];
+    e->pattern = copy;
+    e->positions = positions;
+    e->count = count;
+    e->bytes = bytes;
+    e->hash = hash;
+    e->used = 1;
+    e->referenced = 1;
+    e->next = cache->buckets[hash & (QUERY_CACHE_BUCKETS - 1)];
+    cache->buckets[hash & (QUERY_CACHE_BUCKETS - 1)] = slot;
+    cache->bytesUsed += bytes;
+    cache->usedSlots++;
+    return e;
+}
+
+// Function to answer a pattern from the cache: an exact hit, or the longest cached
+// prefix filtered against the text. Returns NULL on a miss; the caller then scans
+// the text and stores the result with queryCacheInsert.
+static QueryCacheEntry* queryCacheLookup(QueryCache* cache, const char* pat) {
+    free(cache->overflow.positions); // Only valid until the next call, see queryCacheInsert
+    cache->overflow.positions = NULL;
+    cache->overflow.count = 0;
+
+    int M = (int)strlen(pat);
+    unsigned* prefixHash = (unsigned*)malloc((M + 1) * sizeof(unsigned));
+    if (!prefixHash) {
+        cache->misses++;
+        return NULL;
+    }
+    prefixHash[0] = QUERY_CACHE_HASH_SEED;
+    for (int i = 0; i < M; i++) {
+        prefixHash[i + 1] = queryCacheHashStep(prefixHash[i], pat[i]);
+    }
+
+    int slot = queryCacheFind(cache, pat, M, prefixHash[M]);
+    if (slot >= 0) {
+        free(prefixHash);
+        cache->hits++;
+        cache->slots[slot].referenced = 1;
+        return &cache->slots[slot];
+    }
+
+    int k = M - 1;
+    while (k > 0 && (slot = queryCacheFind(cache, pat, k, prefixHash[k])) < 0) {
+        k--;
+    }
+    free(prefixHash);
+    if (k == 0) {
+        cache->misses++;
+        return NULL;
+    }
+
+    // Every occurrence of pat starts with an occurrence of its prefix: keep those that continue
+    QueryCacheEntry* prefix = &cache->slots[slot];
+    prefix->referenced = 1;
+    int* filtered = (int*)malloc((prefix->count + 1) * sizeof(int));
+    if (!filtered) {
+        cache->misses++;
+        return NULL;
+    }
+    int count = 0;
+    for (int p = 0; p < prefix->count; p++) {
+        int start = prefix->positions[p];
+        if (start + M <= cache->textLength && memcmp(cache->text + start + k, pat + k, M - k) == 0) {
+            filtered[count++] = start;
+        }
+    }
+    cache->extensionHits++;
+    return queryCacheInsert(cache, pat, filtered, count);
+}
+
+// Function to release the cache and everything in it
+static void queryCacheFree(QueryCache* cache) {
+    if (!cache) return;
+    for (int s = 0; s < QUERY_CACHE_SLOTS; s++) {
+        if (cache->slots[s].used) queryCacheRemove(cache, s);
+    }
+    free(cache->overflow.positions);
+    free(cache);
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Optional instrumentation shared by the search programs.
+// Pass --stats to print phase timings and engine counters, or --stats-json FILE
+// to also dump them as JSON. When neither flag is given every call below
+// returns immediately, so the engines only pay for their own counter updates.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define STATS_MAX_PHASES 8
+#define STATS_MAX_COUNTERS 32
+#define STATS_HW_EVENTS 3
+
+// One timed phase (load, build, search) with optional hardware counter values
+typedef struct {
+    const char* name;
+    double ms;
+    long long hw[STATS_HW_EVENTS];
+    int hwValid;            // 0 when perf_event_open was not available
+} StatsPhase;
+
+// One named engine counter
+typedef struct {
+    const char* name;
+    long long value;
+} StatsCounter;
+
+static const char* stats_hw_names[STATS_HW_EVENTS] = {"cycles", "llc_misses", "branch_misses"};
+
+static int stats_enabled = 0;               // Set by --stats or --stats-json
+static const char* stats_json_path = NULL;  // Target of --stats-json
+static StatsPhase stats_phases[STATS_MAX_PHASES];
+static int stats_phase_count = 0;
+static StatsCounter stats_counters[STATS_MAX_COUNTERS];
+static int stats_counter_count = 0;
+static struct timespec stats_phase_start;
+static int stats_hw_fd[STATS_HW_EVENTS] = {-1, -1, -1};
+static int stats_hw_opened = 0;
+
+// Function to consume a stats flag at argv[*a]; returns 1 if it was one
+static int statsParseArg(int argc, char* argv[], int* a) {
+    if (strcmp(argv[*a], "--stats") == 0) {
+        stats_enabled = 1;
+        return 1;
+    }
+    if (strcmp(argv[*a], "--stats-json") == 0 && *a + 1 < argc) {
+        stats_enabled = 1;
+        stats_json_path = argv[++(*a)];
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+// Function to open the hardware counters; failures (no PMU, perf_event_paranoid) are not fatal
+static void statsOpenHwCounters(void) {
+    struct perf_event_attr attr;
+    unsigned int types[STATS_HW_EVENTS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+    unsigned long long configs[STATS_HW_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    stats_hw_opened = 1;
+    for (int e = 0; e < STATS_HW_EVENTS; e++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[e];
+        attr.config = configs[e];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1; // Also count threads created later, e.g. the ingest pipeline
+        stats_hw_fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+#endif
+
+// Function to start timing a phase
+static void statsBeginPhase(const char* name) {
+    if (!stats_enabled || stats_phase_count >= STATS_MAX_PHASES) return;
+    stats_phases[stats_phase_count].name = name;
+
+#ifdef __linux__
+    if (!stats_hw_opened) statsOpenHwCounters();
+    for (int e = 0; e < STATS_HW_EVENTS; e++) {
+        if (stats_hw_fd[e] >= 0) {
+            ioctl(stats_hw_fd[e], PERF_EVENT_IOC_RESET, 0);
+            ioctl(stats_hw_fd[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &stats_phase_start);
+}
+
+// Function to stop the phase started last and record its time and counters
+static void statsEndPhase(void) {
+    if (!stats_enabled || stats_phase_count >= STATS_MAX_PHASES) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    StatsPhase* phase = &stats_phases[stats_phase_count++];
+    phase->ms = (now.tv_sec - stats_phase_start.tv_sec) * 1000.0
+              + (now.tv_nsec - stats_phase_start.tv_nsec) / 1e6;
+    phase->hwValid = 0;
+
+#ifdef __linux__
+    phase->hwValid = 1;
+    for (int e = 0; e < STATS_HW_EVENTS; e++) {
+        long long value = 0;
+        if (stats_hw_fd[e] < 0) {
+            phase->hwValid = 0;
+            continue;
+        }
+        ioctl(stats_hw_fd[e], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(stats_hw_fd[e], &value, sizeof(value)) != sizeof(value)) {
+            phase->hwValid = 0;
+        }
+        phase->hw[e] = value;
+    }
+#endif
+}
+
+// Function to record the final value of an engine counter
+static void statsCounter(const char* name, long long value) {
+    if (!stats_enabled || stats_counter_count >= STATS_MAX_COUNTERS) return;
+    stats_counters[stats_counter_count].name = name;
+    stats_counters[stats_counter_count].value = value;
+    stats_counter_count++;
+}
+
+// Function to print the collected stats and write the JSON dump if requested
+static void statsReport(const char* engine) {
+    if (!stats_enabled) return;
+
+    printf("--- stats: %s ---\n", engine);
+    for (int p = 0; p < stats_phase_count; p++) {
+        StatsPhase* phase = &stats_phases[p];
+        printf("  phase %-8s %10.3f ms", phase->name, phase->ms);
+        if (phase->hwValid) {
+            for (int e = 0; e < STATS_HW_EVENTS; e++) {
+                printf("  %s=%lld", stats_hw_names[e], phase->hw[e]);
+            }
+        }
+        printf("\n");
+    }
+    for (int c = 0; c < stats_counter_count; c++) {
+        printf("  %-22s %lld\n", stats_counters[c].name, stats_counters[c].value);
+    }
+
+    if (stats_json_path) {
+        FILE* out = fopen(stats_json_path, "w");
+        if (!out) {
+            perror("Unable to write stats");
+        } else {
+            fprintf(out, "{\"engine\": \"%s\", \"phases\": [", engine);
+            for (int p = 0; p < stats_phase_count; p++) {
+                StatsPhase* phase = &stats_phases[p];
+                fprintf(out, "%s{\"name\": \"%s\", \"ms\": %.3f", p ? ", " : "", phase->name, phase->ms);
+                for (int e = 0; e < STATS_HW_EVENTS; e++) {
+                    if (phase->hwValid) {
+                        fprintf(out, ", \"%s\": %lld", stats_hw_names[e], phase->hw[e]);
+                    } else {
+                        fprintf(out, ", \"%s\": null", stats_hw_names[e]);
+                    }
+                }
+                fprintf(out, "}");
+            }
+            fprintf(out, "], \"counters\": {");
+            for (int c = 0; c < stats_counter_count; c++) {
+                fprintf(out, "%s\"%s\": %lld", c ? ", " : "", stats_counters[c].name, stats_counters[c].value);
+            }
+            fprintf(out, "}}\n");
+            fclose(out);
+        }
+    }
+
+#ifdef __linux__
+    for (int e = 0; e < STATS_HW_EVENTS; e++) {
+        if (stats_hw_fd[e] >= 0) close(stats_hw_fd[e]);
+        stats_hw_fd[e] = -1;
+    }
+#endif
+}
+
+#endif
@@ -1,13 +1,22 @@
+#define _GNU_SOURCE // O_DIRECT in IngestPipeline.h; must come before the first system header
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h> // Include time.h for measuring time
+#include "Stats.h"  // Optional --stats instrumentation
+#include "IngestPipeline.h" // Concurrent read/split/build pipeline
 
 #define ALPHABET_SIZE 256
+#define DEFAULT_BUILDERS 4 // Builder threads used by the ingest pipeline
 #define SUCCESS 0
 #define FAILURE 1
+#define MAX_OCCURRENCES 100 // Occurrences kept per node; further ones are dropped
+#define MAX_PATTERN_LENGTH 255
+#define SESSION_SUGGESTIONS 5 // Occurrences shown after each keystroke
 
 int flag = 0; // Flag to check if pattern is found
+long long st_nodes_allocated = 0; // Nodes created by createSuffixTreeNode
+long long st_truncations = 0;     // Occurrences dropped because a node held MAX_OCCURRENCES
 
 // Struct to store the occurrence details
 typedef struct {
@@ -18,7 +27,7 @@ typedef struct {
 // Node for the suffix tree structure
 typedef struct SuffixTreeNode {
     struct SuffixTreeNode* children[ALPHABET_SIZE]; // Array of child nodes for each possible character
-    Occurrence occurrenceList[100]; // Array to store occurrences of the pattern
+    Occurrence occurrenceList[MAX_OCCURRENCES]; // Array to store occurrences of the pattern
     int occurrenceCount;            // Count of occurrences in this node
 } SuffixTreeNode;
 
@@ -30,6 +39,7 @@ typedef struct {
 // Function to create a new suffix tree node
 SuffixTreeNode* createSuffixTreeNode() {
     SuffixTreeNode* newNode = (SuffixTreeNode*)malloc(sizeof(SuffixTreeNode));
+    __atomic_add_fetch(&st_nodes_allocated, 1, __ATOMIC_RELAXED); // Builders may run in parallel
     // Initialize all children to NULL and occurrence count to 0
     for (int i = 0; i < ALPHABET_SIZE; i++) {
         newNode->children[i] = NULL;
@@ -48,8 +58,9 @@ SuffixTree* initializeSuffixTree() {
 // Function to add a suffix to the tree
 void addSuffixToTree(SuffixTree* suffixTree, const char* suffix, int lineNum, int startIndex) {
     SuffixTreeNode* currentNode = suffixTree->rootNode;
+    long long truncations = 0;
     for (int i = startIndex; suffix[i] != '\0'; i++) {
-        char character = suffix[i];
+        unsigned char character = (unsigned char)suffix[i];
         // Create a new node if the character path doesn't exist
         if (currentNode->children[character] == NULL) {
             currentNode->children[character] = createSuffixTreeNode();
@@ -57,10 +68,27 @@ void addSuffixToTree(SuffixTree* suffixTree, const char* suffix, int lineNum, in
         currentNode = currentNode->children[character];
 
         // Add occurrence info if occurrence list isn't full
-        if (currentNode->occurrenceCount < 100) {
+        if (currentNode->occurrenceCount < MAX_OCCURRENCES) {
             currentNode->occurrenceList[currentNode->occurrenceCount].lineNumber = lineNum + 1;
             currentNode->occurrenceList[currentNode->occurrenceCount].startIndex = startIndex;
             currentNode->occurrenceCount++;
+        } else {
+            truncations++;
+        }
+    }
+    if (truncations > 0) {
+        __atomic_add_fetch(&st_truncations, truncations, __ATOMIC_RELAXED);
+    }
+}
+
+// Function to insert one line for the ingest pipeline. Each builder takes the suffixes
+// whose first character maps to it, so builders fill disjoint subtrees of the root.
+void insertLineSuffixes(void* index, const char* line, int lineNum, int builder, int builders) {
+    SuffixTree* suffixTree = (SuffixTree*)index;
+    int length = strlen(line);
+    for (int i = 0; i < length; i++) {
+        if ((unsigned char)line[i] % builders == builder) {
+            addSuffixToTree(suffixTree, line, lineNum, i);
         }
     }
 }
@@ -77,6 +105,23 @@ void buildSuffixTreeFromLines(SuffixTree* suffixTree, char** lines, int lineCoun
     }
 }
 
+// Function to print one occurrence together with the word containing it
+void printOccurrence(const Occurrence* occurrence, char** lines) {
+    int lineNum = occurrence->lineNumber;
+    int startIndex = occurrence->startIndex;
+
+    // Find the word containing the pattern
+    const char* line = lines[lineNum - 1];
+    int wordStart = startIndex;
+    while (wordStart > 0 && line[wordStart - 1] != ' ') wordStart--; // Move to start of the word
+    int wordEnd = startIndex;
+    while (line[wordEnd] != '\0' && line[wordEnd] != ' ') wordEnd++; // Move to end of the word
+
+    // Output the position of the pattern and the word, printed in place since lines have no length limit
+    printf("  Found at Line: %d, Position in line: %d, Word: '%.*s'\n", lineNum, startIndex + 1,
+           wordEnd - wordStart, line + wordStart);
+}
+
 // Function to search for a pattern in the suffix tree
 void findPatternInTree(SuffixTreeNode* node, const char* pattern, int index, char** lines) {
     if (node == NULL) return;
@@ -87,23 +132,7 @@ void findPatternInTree(SuffixTreeNode* node, const char* pattern, int index, cha
         if (node->occurrenceCount > 0) {
             printf("Pattern found!\n");
             for (int i = 0; i < node->occurrenceCount; i++) {
-                int lineNum = node->occurrenceList[i].lineNumber;
-                int startIndex = node->occurrenceList[i].startIndex;
-
-                // Find the word containing the pattern
-                const char* line = lines[lineNum - 1];
-                int wordStart = startIndex;
-                while (wordStart > 0 && line[wordStart - 1] != ' ') wordStart--; // Move to start of the word
-                int wordEnd = startIndex;
-                while (line[wordEnd] != '\0' && line[wordEnd] != ' ') wordEnd++; // Move to end of the word
-
-                // Extract the word
-                char foundWord[256];
-                strncpy(foundWord, line + wordStart, wordEnd - wordStart);
-                foundWord[wordEnd - wordStart] = '\0';
-
-                // Output the position of the pattern and the word
-                printf("  Found at Line: %d, Position in line: %d, Word: '%s'\n", lineNum, startIndex + 1, foundWord);
+                printOccurrence(&node->occurrenceList[i], lines);
                 cnt++;
             }
             flag = 1; // Set flag to indicate pattern found
@@ -113,10 +142,75 @@ void findPatternInTree(SuffixTreeNode* node, const char* pattern, int index, cha
     }
 
     // Recursive call to check the next character in the pattern
-    char character = pattern[index];
+    unsigned char character = (unsigned char)pattern[index];
     findPatternInTree(node->children[character], pattern, index + 1, lines);
 }
 
+// Incremental search state for auto-suggestion: one tree position per typed character
+typedef struct {
+    SuffixTreeNode* path[MAX_PATTERN_LENGTH + 1]; // path[k] = node for the first k characters, NULL if none
+    char prefix[MAX_PATTERN_LENGTH + 1];
+    int depth;
+} SuffixTreeSession;
+
+// Function to start a session with an empty prefix at the root of the tree
+void startSuffixTreeSession(SuffixTreeSession* session, SuffixTree* suffixTree) {
+    session->path[0] = suffixTree->rootNode;
+    session->prefix[0] = '\0';
+    session->depth = 0;
+}
+
+// Function to extend the prefix by one character: a single child lookup from the current node
+int appendToSuffixTreeSession(SuffixTreeSession* session, char character) {
+    if (session->depth == MAX_PATTERN_LENGTH) return 0;
+    SuffixTreeNode* node = session->path[session->depth];
+    session->prefix[session->depth] = character;
+    session->depth++;
+    session->prefix[session->depth] = '\0';
+    session->path[session->depth] = node ? node->children[(unsigned char)character] : NULL;
+    return 1;
+}
+
+// Function to erase the last character by popping the node stack
+void backspaceSuffixTreeSession(SuffixTreeSession* session) {
+    if (session->depth == 0) return;
+    session->depth--;
+    session->prefix[session->depth] = '\0';
+}
+
+// Function to run an interactive session: every character read is a keystroke, '<' erases one
+long long runSuffixTreeSession(SuffixTree* suffixTree, char** lines) {
+    SuffixTreeSession session;
+    startSuffixTreeSession(&session, suffixTree);
+    long long keystrokes = 0;
+    int ch;
+
+    printf("Type the pattern one character at a time ('<' erases the last character):\n");
+    while ((ch = getchar()) != EOF) {
+        if (ch == '\n' || ch == '\r') continue;
+
+        clock_t start_time = clock();
+        if (ch == '<' || ch == '\b' || ch == 127) {
+            backspaceSuffixTreeSession(&session);
+        } else if (!appendToSuffixTreeSession(&session, (char)ch)) {
+            printf("Pattern is limited to %d characters.\n", MAX_PATTERN_LENGTH);
+            continue;
+        }
+        SuffixTreeNode* node = session.path[session.depth];
+        clock_t end_time = clock();
+        keystrokes++;
+
+        int cnt = node ? node->occurrenceCount : 0;
+        printf("Prefix '%s': %d occurrences (%.3f ms)\n", session.prefix, cnt,
+               ((double)(end_time - start_time) / CLOCKS_PER_SEC) * 1000);
+        for (int i = 0; i < cnt && i < SESSION_SUGGESTIONS; i++) {
+            printOccurrence(&node->occurrenceList[i], lines);
+        }
+        if (cnt > 0) flag = 1;
+    }
+    return keystrokes;
+}
+
 // Function to release memory used by the suffix tree
 void releaseSuffixTree(SuffixTreeNode* node) {
     // Recursively free each child node
@@ -129,54 +223,143 @@ void releaseSuffixTree(SuffixTreeNode* node) {
 }
 
 // Function to load lines from a file into an array
-char** loadLinesFromFile(const char* filename, int* lineCount) {
+char** loadLinesFromFile(const char* filename, int* lineCount, long long* bytesRead) {
     FILE* file = fopen(filename, "r");
     if (!file) {
         perror("Unable to open file");
         return NULL;
     }
 
-    char** lines = malloc(100 * sizeof(char*)); // Allocate memory for lines
+    int capacity = 100;
+    char** lines = malloc(capacity * sizeof(char*)); // Allocate memory for lines, grown as needed
     *lineCount = 0;
-    char line[256];
+    *bytesRead = 0;
+    char* line = NULL; // Grown by getline, so long lines are kept whole like the pipeline does
+    size_t lineCapacity = 0;
+    ssize_t length;
 
     // Read lines from the file
-    while (fgets(line, sizeof(line), file)) {
+    while (lines && (length = getline(&line, &lineCapacity, file)) != -1) {
+        *bytesRead += length; // Bytes as in the file, newline included, to match the pipeline's count
+        if (*lineCount == capacity) {
+            char** grown = realloc(lines, capacity * 2 * sizeof(char*));
+            if (!grown) break;
+            lines = grown;
+            capacity *= 2;
+        }
         line[strcspn(line, "\n")] = 0; // Remove newline character
         lines[*lineCount] = strdup(line); // Duplicate line to store in array
+        if (!lines[*lineCount]) break;
         (*lineCount)++;
     }
+    int failed = !lines || !feof(file);
+    if (failed && ferror(file)) {
+        perror("Unable to read file");
+    } else if (failed) {
+        printf("Memory allocation failed.\n");
+    }
+    free(line);
     fclose(file);
+    if (failed) {
+        for (int i = 0; lines && i < *lineCount; i++) {
+            free(lines[i]);
+        }
+        free(lines);
+        return NULL;
+    }
     return lines;
 }
 
-int main() {
-    const char* filename = "sherlock2.txt";
-    int lineCount = 0;
-    char** lines = loadLinesFromFile(filename, &lineCount);
-    if (lines == NULL) {
-        return FAILURE; // Exit if file can't be loaded
+int main(int argc, char* argv[]) {
+    int sessionMode = 0;
+    int sequential = 0;              // Load everything first, then build, as before the pipeline
+    int builders = DEFAULT_BUILDERS; // Builder threads in the ingest pipeline
+    int directIO = 0;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--session") == 0) {
+            sessionMode = 1;
+        } else if (strcmp(argv[a], "--sequential") == 0) {
+            sequential = 1;
+        } else if (strcmp(argv[a], "--builders") == 0 && a + 1 < argc) {
+            builders = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--direct-io") == 0) {
+            directIO = 1;
+        } else if (!statsParseArg(argc, argv, &a)) {
+            printf("Usage: %s [--session] [--sequential | --builders N [--direct-io]] [--stats] [--stats-json FILE]\n",
+                   argv[0]);
+            return FAILURE;
+        }
     }
 
+    const char* filename = "sherlock2.txt";
+    int lineCount = 0;
     SuffixTree* suffixTree = initializeSuffixTree(); // Initialize the suffix tree
-    buildSuffixTreeFromLines(suffixTree, lines, lineCount); // Build the tree from lines
-
-    char pattern[256];
-    printf("Enter the pattern to search: ");
-    scanf("%255s", pattern);
-
-    // Start time measurement for pattern search
-    clock_t start_time = clock();
+    char** lines;
+    if (sequential) {
+        struct timespec start_time, end_time; // Wall clock, comparable with the pipeline's figure
+        long long bytes = 0;                  // Bytes of the file, counted as the pipeline does
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        statsBeginPhase("load");
+        lines = loadLinesFromFile(filename, &lineCount, &bytes);
+        statsEndPhase();
+        if (lines == NULL) {
+            releaseSuffixTree(suffixTree->rootNode);
+            free(suffixTree);
+            return FAILURE; // Exit if file can't be loaded
+        }
 
-    // Search for pattern in the tree
-    findPatternInTree(suffixTree->rootNode, pattern, 0, lines);
+        statsBeginPhase("build");
+        buildSuffixTreeFromLines(suffixTree, lines, lineCount); // Build the tree from lines
+        statsEndPhase();
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        double seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+        printf("Loaded %lld bytes, %d lines and built in %.2f ms (%.2f MB/s, sequential)\n",
+               bytes, lineCount, seconds * 1000, seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+    } else {
+        // Reading, line splitting and insertion overlap in the ingest pipeline
+        statsBeginPhase("ingest");
+        lines = ingestFile(filename, insertLineSuffixes, suffixTree, builders, directIO, &lineCount);
+        statsEndPhase();
+        if (lines == NULL) {
+            releaseSuffixTree(suffixTree->rootNode);
+            free(suffixTree);
+            return FAILURE; // Exit if file can't be loaded
+        }
+    }
 
-    // End time measurement for pattern search
-    clock_t end_time = clock();
+    if (sessionMode) {
+        // Keystroke-by-keystroke search from the node reached so far
+        statsBeginPhase("session");
+        long long keystrokes = runSuffixTreeSession(suffixTree, lines);
+        statsEndPhase();
+        statsCounter("keystrokes", keystrokes);
+    } else {
+        char pattern[256];
+        printf("Enter the pattern to search: ");
+        scanf("%255s", pattern);
+
+        // Start time measurement for pattern search
+        statsBeginPhase("search");
+        clock_t start_time = clock();
+
+        // Search for pattern in the tree
+        findPatternInTree(suffixTree->rootNode, pattern, 0, lines);
+
+        // End time measurement for pattern search
+        clock_t end_time = clock();
+        statsEndPhase();
+
+        // Calculate and display the elapsed time in milliseconds
+        double time_taken = ((double)(end_time - start_time) / CLOCKS_PER_SEC) * 1000;
+        printf("Time taken for search: %.2f ms\n", time_taken);
+    }
 
-    // Calculate and display the elapsed time in milliseconds
-    double time_taken = ((double)(end_time - start_time) / CLOCKS_PER_SEC) * 1000;
-    printf("Time taken for search: %.2f ms\n", time_taken);
+    statsCounter("lines", lineCount);
+    statsCounter("nodes_allocated", st_nodes_allocated);
+    statsCounter("node_bytes", (long long)sizeof(SuffixTreeNode));
+    statsCounter("tree_bytes", st_nodes_allocated * (long long)sizeof(SuffixTreeNode));
+    statsCounter("occurrence_truncations", st_truncations);
+    statsReport("suffix_tree");
 
     // Free allocated memory for lines and suffix tree
     for (int i = 0; i < lineCount; i++) {
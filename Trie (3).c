@@ -1,10 +1,19 @@
+#define _GNU_SOURCE // O_DIRECT in IngestPipeline.h; must come before the first system header
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h> // For measuring time
+#include "Stats.h"  // Optional --stats instrumentation
+#include "IngestPipeline.h" // Concurrent read/split/build pipeline
 
 #define ALPHABET_SIZE 256
+#define DEFAULT_BUILDERS 4 // Builder threads used by the ingest pipeline
 #define MAX_OCCURRENCES 100
+#define MAX_PATTERN_LENGTH 255
+#define SESSION_SUGGESTIONS 5 // Occurrences shown after each keystroke
+
+long long trie_nodes_allocated = 0; // Nodes created by createTrieNode
+long long trie_truncations = 0;     // Occurrences dropped because a node held MAX_OCCURRENCES
 
 // Struct to store occurrence details
 typedef struct {
@@ -27,6 +36,7 @@ typedef struct {
 // Function to create a new trie node
 TrieNode* createTrieNode() {
     TrieNode* newNode = (TrieNode*)malloc(sizeof(TrieNode));
+    __atomic_add_fetch(&trie_nodes_allocated, 1, __ATOMIC_RELAXED); // Builders may run in parallel
     for (int i = 0; i < ALPHABET_SIZE; i++) {
         newNode->children[i] = NULL;
     }
@@ -44,8 +54,9 @@ Trie* initializeTrie() {
 // Function to insert a word into the trie
 void insertWord(Trie* trie, const char* word, int lineNum, int startIndex) {
     TrieNode* currentNode = trie->root;
+    long long truncations = 0;
     for (int i = 0; word[i] != '\0'; i++) {
-        char character = word[i];
+        unsigned char character = (unsigned char)word[i];
         if (currentNode->children[character] == NULL) {
             currentNode->children[character] = createTrieNode();
         }
@@ -56,6 +67,23 @@ void insertWord(Trie* trie, const char* word, int lineNum, int startIndex) {
             currentNode->occurrenceList[currentNode->occurrenceCount].lineNumber = lineNum + 1;
             currentNode->occurrenceList[currentNode->occurrenceCount].startIndex = startIndex + 1;
             currentNode->occurrenceCount++;
+        } else {
+            truncations++;
+        }
+    }
+    if (truncations > 0) {
+        __atomic_add_fetch(&trie_truncations, truncations, __ATOMIC_RELAXED);
+    }
+}
+
+// Function to insert one line for the ingest pipeline. Each builder takes the suffixes
+// whose first character maps to it, so builders fill disjoint subtrees of the root.
+void insertLineSuffixes(void* index, const char* line, int lineNum, int builder, int builders) {
+    Trie* trie = (Trie*)index;
+    int length = strlen(line);
+    for (int i = 0; i < length; i++) {
+        if ((unsigned char)line[i] % builders == builder) {
+            insertWord(trie, line + i, lineNum, i);
         }
     }
 }
@@ -91,10 +119,75 @@ void searchPatternInTrie(TrieNode* node, const char* pattern, int index) {
     }
 
     // Recursive search for the next character in the pattern
-    char character = pattern[index];
+    unsigned char character = (unsigned char)pattern[index];
     searchPatternInTrie(node->children[character], pattern, index + 1);
 }
 
+// Incremental search state for auto-suggestion: one trie node per typed character
+typedef struct {
+    TrieNode* path[MAX_PATTERN_LENGTH + 1]; // path[k] = node for the first k characters, NULL if none
+    char prefix[MAX_PATTERN_LENGTH + 1];
+    int depth;
+} TrieSession;
+
+// Function to start a session with an empty prefix at the root of the trie
+void startTrieSession(TrieSession* session, Trie* trie) {
+    session->path[0] = trie->root;
+    session->prefix[0] = '\0';
+    session->depth = 0;
+}
+
+// Function to extend the prefix by one character: a single child lookup from the current node
+int appendToTrieSession(TrieSession* session, char character) {
+    if (session->depth == MAX_PATTERN_LENGTH) return 0;
+    TrieNode* node = session->path[session->depth];
+    session->prefix[session->depth] = character;
+    session->depth++;
+    session->prefix[session->depth] = '\0';
+    session->path[session->depth] = node ? node->children[(unsigned char)character] : NULL;
+    return 1;
+}
+
+// Function to erase the last character by popping the node stack
+void backspaceTrieSession(TrieSession* session) {
+    if (session->depth == 0) return;
+    session->depth--;
+    session->prefix[session->depth] = '\0';
+}
+
+// Function to run an interactive session: every character read is a keystroke, '<' erases one
+long long runTrieSession(Trie* trie) {
+    TrieSession session;
+    startTrieSession(&session, trie);
+    long long keystrokes = 0;
+    int ch;
+
+    printf("Type the pattern one character at a time ('<' erases the last character):\n");
+    while ((ch = getchar()) != EOF) {
+        if (ch == '\n' || ch == '\r') continue;
+
+        clock_t start_time = clock();
+        if (ch == '<' || ch == '\b' || ch == 127) {
+            backspaceTrieSession(&session);
+        } else if (!appendToTrieSession(&session, (char)ch)) {
+            printf("Pattern is limited to %d characters.\n", MAX_PATTERN_LENGTH);
+            continue;
+        }
+        TrieNode* node = session.path[session.depth];
+        clock_t end_time = clock();
+        keystrokes++;
+
+        int cnt = node ? node->occurrenceCount : 0;
+        printf("Prefix '%s': %d occurrences (%.3f ms)\n", session.prefix, cnt,
+               ((double)(end_time - start_time) / CLOCKS_PER_SEC) * 1000);
+        for (int i = 0; i < cnt && i < SESSION_SUGGESTIONS; i++) {
+            printf("  Found at Line: %d, Position in line: %d\n",
+                   node->occurrenceList[i].lineNumber, node->occurrenceList[i].startIndex);
+        }
+    }
+    return keystrokes;
+}
+
 // Function to free the trie memory
 void freeTrie(TrieNode* node) {
     if (node == NULL) return;
@@ -105,51 +198,140 @@ void freeTrie(TrieNode* node) {
 }
 
 // Function to load lines from a file into an array
-char** loadLinesFromFile(const char* filename, int* lineCount) {
+char** loadLinesFromFile(const char* filename, int* lineCount, long long* bytesRead) {
     FILE* file = fopen(filename, "r");
     if (!file) {
         perror("Unable to open file");
         return NULL;
     }
 
-    char** lines = malloc(100 * sizeof(char*));
+    int capacity = 100;
+    char** lines = malloc(capacity * sizeof(char*));
     *lineCount = 0;
-    char line[256];
-
-    while (fgets(line, sizeof(line), file)) {
+    *bytesRead = 0;
+    char* line = NULL; // Grown by getline, so long lines are kept whole like the pipeline does
+    size_t lineCapacity = 0;
+    ssize_t length;
+
+    while (lines && (length = getline(&line, &lineCapacity, file)) != -1) {
+        *bytesRead += length; // Bytes as in the file, newline included, to match the pipeline's count
+        if (*lineCount == capacity) {
+            char** grown = realloc(lines, capacity * 2 * sizeof(char*));
+            if (!grown) break;
+            lines = grown;
+            capacity *= 2;
+        }
         line[strcspn(line, "\n")] = 0;
         lines[*lineCount] = strdup(line);
+        if (!lines[*lineCount]) break;
         (*lineCount)++;
     }
+    int failed = !lines || !feof(file);
+    if (failed && ferror(file)) {
+        perror("Unable to read file");
+    } else if (failed) {
+        printf("Memory allocation failed.\n");
+    }
+    free(line);
     fclose(file);
+    if (failed) {
+        for (int i = 0; lines && i < *lineCount; i++) {
+            free(lines[i]);
+        }
+        free(lines);
+        return NULL;
+    }
     return lines;
 }
 
-int main() {
-    const char* filename = "sherlock2.txt";
-    int lineCount = 0;
-    char** lines = loadLinesFromFile(filename, &lineCount);
-    if (lines == NULL) {
-        return 1;
+int main(int argc, char* argv[]) {
+    int sessionMode = 0;
+    int sequential = 0;              // Load everything first, then build, as before the pipeline
+    int builders = DEFAULT_BUILDERS; // Builder threads in the ingest pipeline
+    int directIO = 0;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--session") == 0) {
+            sessionMode = 1;
+        } else if (strcmp(argv[a], "--sequential") == 0) {
+            sequential = 1;
+        } else if (strcmp(argv[a], "--builders") == 0 && a + 1 < argc) {
+            builders = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--direct-io") == 0) {
+            directIO = 1;
+        } else if (!statsParseArg(argc, argv, &a)) {
+            printf("Usage: %s [--session] [--sequential | --builders N [--direct-io]] [--stats] [--stats-json FILE]\n",
+                   argv[0]);
+            return 1;
+        }
     }
 
+    const char* filename = "sherlock2.txt";
+    int lineCount = 0;
     Trie* trie = initializeTrie();
-    buildTrieFromLines(trie, lines, lineCount);
-
-    char pattern[256];
-    printf("Enter the pattern to search: ");
-    scanf("%255s", pattern);
+    char** lines;
+    if (sequential) {
+        struct timespec start_time, end_time; // Wall clock, comparable with the pipeline's figure
+        long long bytes = 0;                  // Bytes of the file, counted as the pipeline does
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        statsBeginPhase("load");
+        lines = loadLinesFromFile(filename, &lineCount, &bytes);
+        statsEndPhase();
+        if (lines == NULL) {
+            freeTrie(trie->root);
+            free(trie);
+            return 1;
+        }
 
-    // Start time measurement for pattern search
-    clock_t start_time = clock();
+        statsBeginPhase("build");
+        buildTrieFromLines(trie, lines, lineCount);
+        statsEndPhase();
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        double seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+        printf("Loaded %lld bytes, %d lines and built in %.2f ms (%.2f MB/s, sequential)\n",
+               bytes, lineCount, seconds * 1000, seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+    } else {
+        // Reading, line splitting and insertion overlap in the ingest pipeline
+        statsBeginPhase("ingest");
+        lines = ingestFile(filename, insertLineSuffixes, trie, builders, directIO, &lineCount);
+        statsEndPhase();
+        if (lines == NULL) {
+            freeTrie(trie->root);
+            free(trie);
+            return 1;
+        }
+    }
 
-    // Search for the pattern in the trie
-    searchPatternInTrie(trie->root, pattern, 0);
+    if (sessionMode) {
+        // Keystroke-by-keystroke search from the node reached so far
+        statsBeginPhase("session");
+        long long keystrokes = runTrieSession(trie);
+        statsEndPhase();
+        statsCounter("keystrokes", keystrokes);
+    } else {
+        char pattern[256];
+        printf("Enter the pattern to search: ");
+        scanf("%255s", pattern);
+
+        // Start time measurement for pattern search
+        statsBeginPhase("search");
+        clock_t start_time = clock();
+
+        // Search for the pattern in the trie
+        searchPatternInTrie(trie->root, pattern, 0);
+
+        // End time measurement
+        clock_t end_time = clock();
+        statsEndPhase();
+        double time_taken = ((double)(end_time - start_time) / CLOCKS_PER_SEC) * 1000;
+        printf("Time taken for search: %.2f ms\n", time_taken);
+    }
 
-    // End time measurement
-    clock_t end_time = clock();
-    double time_taken = ((double)(end_time - start_time) / CLOCKS_PER_SEC) * 1000;
-    printf("Time taken for search: %.2f ms\n", time_taken);
+    statsCounter("lines", lineCount);
+    statsCounter("nodes_allocated", trie_nodes_allocated);
+    statsCounter("node_bytes", (long long)sizeof(TrieNode));
+    statsCounter("trie_bytes", trie_nodes_allocated * (long long)sizeof(TrieNode));
+    statsCounter("occurrence_truncations", trie_truncations);
+    statsReport("trie");
 
     // Free memory for lines and trie
     for (int i = 0; i < lineCount; i++) {